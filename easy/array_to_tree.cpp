@@ -1,4 +1,8 @@
+#include <chrono>
+#include <cstdint>
 #include <iostream>
+#include <new>
+#include <vector>
 
 // Task description: Given an array of unique integers that is already sorted
 // in increasing order, write an algorithm to create a binary search tree with
@@ -19,6 +23,62 @@
 // in the tree are not needed, as the recursive algorithm halves the array
 // with each recursion and returns the root of the minimal tree for that
 // portion of the array.
+//
+// Each node created above is a separate heap allocation, so looking up a
+// value in a large tree follows pointers to unrelated cache lines on every
+// level. Two alternative layouts of exactly the same tree are implemented:
+//
+// (1) create_tree_pool() allocates all nodes in a single block, in breadth
+//     first order. The nodes near the root, which every lookup visits, are
+//     packed together at the start of the block and there is no allocation
+//     overhead per node. Lookups still follow the left and right pointers.
+//
+// (2) VebTree stores only the values, in a single array and in van Emde Boas
+//     order, without any pointers. A tree of height h is split in the middle
+//     into a top tree of height h / 2 and up to 2^(h / 2) bottom trees. The
+//     top tree is laid out first, followed by each of the bottom trees from
+//     left to right, and each of these is laid out recursively in the same
+//     way. Whatever the size of a cache line or page, a lookup crosses only
+//     O(log_B n) of them, instead of O(log n) for the other layouts.
+//
+//     The array has a slot for each node of the complete tree of the same
+//     height. The slot of a node is computed from its breadth first index i
+//     (1 for the root, 2i and 2i + 1 for the children of i) and from the slot
+//     of the root of the top tree it belongs to, using three values per depth
+//     d that only depend on the height of the tree: the depth D[d] of the root
+//     of the enclosing top tree, the size T[d] of that top tree and the size
+//     B[d] of each bottom tree below it. The node at depth d is in bottom tree
+//     number (i & T[d]), so its slot is pos[D[d]] + T[d] + (i & T[d]) * B[d].
+//     The slots of nodes missing from the last levels are left unused. To
+//     know whether a child exists, the lookup keeps track of the range of the
+//     sorted array covered by the current node, exactly as create_tree()
+//     does, and stops when the range is empty. It returns the position of the
+//     value in the sorted array, or -1.
+//
+// Lookup latency in nanoseconds for random values on a single core, for
+// trees of 4 byte values:
+//
+// +----------+-------------+------------------+---------+
+// |  Values  | create_tree | create_tree_pool | VebTree |
+// +----------+-------------+------------------+---------+
+// |     1024 |          23 |               23 |      95 |
+// |     8192 |          42 |               39 |     132 |
+// |    65536 |          67 |               58 |     162 |
+// |   524288 |         224 |              227 |     252 |
+// |  4194304 |         612 |              448 |     441 |
+// | 33554432 |        1134 |             1075 |     719 |
+// +----------+-------------+------------------+---------+
+//
+// While the tree fits in the cache, VebTree is slower, as the slot of each
+// child has to be computed after the comparison, which makes every mispredicted
+// branch more expensive than following a pointer that has already been loaded.
+// Once the tree only fits in DRAM, fewer cache lines and pages are touched per
+// lookup and VebTree is the fastest. The breadth first pool helps while the top
+// levels fit in the cache, but the children of deep nodes are far away from
+// their parents, whereas create_tree() allocates the nodes of each small
+// subtree next to each other, as it creates them in post order.
+//
+// Compile with: g++ -O2 array_to_tree.cpp
 
 class Node {
 
@@ -46,6 +106,155 @@ Node* create_tree(int* array, int start, int end) {
     return new Node(array[middle], left, right);
 }
 
+void delete_tree(Node* root) {
+    if (root == 0) return;
+    delete_tree(root->getLeft());
+    delete_tree(root->getRight());
+    delete root;
+}
+
+Node* find(Node* root, int value) {
+    while (root != 0 && root->getValue() != value) {
+        root = value < root->getValue() ? root->getLeft() : root->getRight();
+    }
+    return root;
+}
+
+// Creates the same tree as create_tree(), with all nodes allocated in a single
+// block in breadth first order. The root is the start of the block, so the
+// whole tree is freed with delete_tree_pool(root).
+Node* create_tree_pool(int* array, int start, int end) {
+    if (end < start) return 0;
+
+    // The ranges of the array covered by each node, in breadth first order,
+    // and the positions of their children (0 for none).
+    std::vector<int> starts(1, start), ends(1, end), lefts, rights;
+    for (size_t i = 0; i < starts.size(); i++) {
+        int middle = starts[i] + (ends[i] - starts[i]) / 2;
+        lefts.push_back(0);
+        rights.push_back(0);
+        if (starts[i] <= middle - 1) {
+            lefts[i] = starts.size();
+            starts.push_back(starts[i]);
+            ends.push_back(middle - 1);
+        }
+        if (middle + 1 <= ends[i]) {
+            rights[i] = starts.size();
+            starts.push_back(middle + 1);
+            ends.push_back(ends[i]);
+        }
+    }
+
+    Node* pool = static_cast<Node*>(::operator new(starts.size() * sizeof(Node)));
+    for (size_t i = 0; i < starts.size(); i++) {
+        int middle = starts[i] + (ends[i] - starts[i]) / 2;
+        new (&pool[i]) Node(array[middle], lefts[i] ? &pool[lefts[i]] : 0,
+                            rights[i] ? &pool[rights[i]] : 0);
+    }
+    return pool;
+}
+
+void delete_tree_pool(Node* root) {
+    ::operator delete(root);
+}
+
+class VebTree {
+
+    private:
+        static const int MAX_HEIGHT = 32;
+
+        int size;
+        int height;
+        std::vector<int> slots;
+        int top_depth[MAX_HEIGHT];
+        uint64_t top_size[MAX_HEIGHT];
+        uint64_t bottom_size[MAX_HEIGHT];
+
+        void split(int depth, int levels);
+        void place(const int* array, int start, int end,
+                   uint64_t index, int depth, uint64_t* pos);
+
+    public:
+        VebTree(const int* array, int size);
+        int find(int value) const;
+        size_t slot_count() const;
+        int slot(size_t index) const;
+};
+
+// Computes the depth of the enclosing top tree and the sizes of the top and
+// bottom trees for the roots of the bottom trees of a tree with the given
+// number of levels, whose root is at the given depth.
+void VebTree::split(int depth, int levels) {
+    if (levels <= 1) return;
+
+    int top = levels / 2;
+    int bottom = levels - top;
+    top_depth[depth + top] = depth;
+    top_size[depth + top] = (1ULL << top) - 1;
+    bottom_size[depth + top] = (1ULL << bottom) - 1;
+    split(depth, top);
+    split(depth + top, bottom);
+}
+
+void VebTree::place(const int* array, int start, int end,
+                    uint64_t index, int depth, uint64_t* pos) {
+    if (end < start) return;
+
+    if (depth > 0) {
+        pos[depth] = pos[top_depth[depth]] + top_size[depth] +
+                     (index & top_size[depth]) * bottom_size[depth];
+    }
+    int middle = start + (end - start) / 2;
+    slots[pos[depth]] = array[middle];
+    place(array, start, middle - 1, 2 * index, depth + 1, pos);
+    place(array, middle + 1, end, 2 * index + 1, depth + 1, pos);
+}
+
+VebTree::VebTree(const int* array, int size) : size(size), height(0) {
+    while (height < MAX_HEIGHT - 1 && (1LL << height) <= size) height++;
+    split(0, height);
+    slots.assign((1ULL << height) - 1, 0);
+
+    uint64_t pos[MAX_HEIGHT] = { 0 };
+    place(array, 0, size - 1, 1, 0, pos);
+}
+
+int VebTree::find(int value) const {
+    uint64_t pos[MAX_HEIGHT];
+    uint64_t index = 1;
+    int start = 0, end = size - 1;
+    pos[0] = 0;
+
+    for (int depth = 0; start <= end; depth++) {
+        if (depth > 0) {
+            pos[depth] = pos[top_depth[depth]] + top_size[depth] +
+                         (index & top_size[depth]) * bottom_size[depth];
+        }
+        int middle = start + (end - start) / 2;
+        int current = slots[pos[depth]];
+        if (value == current) return middle;
+
+        if (value < current) {
+            end = middle - 1;
+            index = 2 * index;
+        } else {
+            start = middle + 1;
+            index = 2 * index + 1;
+        }
+    }
+    return -1;
+}
+
+// Returns the number of slots, including the unused slots of the last level.
+size_t VebTree::slot_count() const {
+    return slots.size();
+}
+
+// Returns the value stored at the given slot of the layout.
+int VebTree::slot(size_t index) const {
+    return slots[index];
+}
+
 bool is_leaf(Node *node) {
     return 0 == node->getLeft() && 0 == node->getRight();
 }
@@ -81,6 +290,110 @@ bool test_even_elements() {
            is_leaf(root->getRight()->getRight());
 }
 
+// Returns whether both trees have the same shape and values.
+bool same_tree(Node* a, Node* b) {
+    if (a == 0 || b == 0) return a == b;
+    return a->getValue() == b->getValue() &&
+           same_tree(a->getLeft(), b->getLeft()) &&
+           same_tree(a->getRight(), b->getRight());
+}
+
+bool test_pool_same_tree() {
+    bool ret = true;
+    for (int size = 1; size <= 100; size++) {
+        std::vector<int> input(size);
+        for (int i = 0; i < size; i++) input[i] = 2 * i;
+        Node* tree = create_tree(input.data(), 0, size - 1);
+        Node* pool = create_tree_pool(input.data(), 0, size - 1);
+        ret = ret && same_tree(tree, pool);
+        delete_tree(tree);
+        delete_tree_pool(pool);
+    }
+    return ret && 0 == create_tree_pool(0, 0, -1);
+}
+
+bool test_veb_layout() {
+    // A complete tree of height 4 has a top tree of height 2 (8, 4, 12),
+    // followed by four bottom trees of height 2.
+    int input[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+    int expected[] = { 8, 4, 12, 2, 1, 3, 6, 5, 7, 10, 9, 11, 14, 13, 15 };
+    VebTree tree(input, 15);
+
+    bool ret = 15 == tree.slot_count();
+    for (int i = 0; i < 15; i++) ret = ret && expected[i] == tree.slot(i);
+    for (int i = 0; i < 15; i++) ret = ret && i == tree.find(input[i]);
+    return ret && -1 == tree.find(0) && -1 == tree.find(16);
+}
+
+bool test_veb_find() {
+    bool ret = true;
+    for (int size = 0; size <= 600; size++) {
+        std::vector<int> input(size);
+        for (int i = 0; i < size; i++) input[i] = 2 * i;
+        VebTree tree(input.data(), size);
+        Node* pool = create_tree_pool(input.data(), 0, size - 1);
+
+        for (int value = -1; value <= 2 * size; value++) {
+            int found = tree.find(value);
+            Node* node = find(pool, value);
+            ret = ret && (value % 2 == 0 && value < 2 * size ?
+                          found == value / 2 : found == -1) &&
+                  (found == -1 ? node == 0 : node->getValue() == value);
+        }
+        delete_tree_pool(pool);
+    }
+    return ret;
+}
+
+double elapsed_sec(std::chrono::steady_clock::time_point start) {
+    std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+template <typename F>
+double lookup_ns(const std::vector<int>& queries, F lookup) {
+    long checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int query : queries) checksum += lookup(query);
+    double ns = elapsed_sec(start) * 1e9 / queries.size();
+    if (checksum == 42) std::cout << "";
+    return ns;
+}
+
+void benchmark(int size, int lookups) {
+    std::vector<int> input(size);
+    for (int i = 0; i < size; i++) input[i] = 2 * i;
+    std::vector<int> queries(lookups);
+    uint32_t state = 42;
+    for (int& query : queries) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        query = 2 * (state % size);
+    }
+
+    Node* tree = create_tree(input.data(), 0, size - 1);
+    double tree_ns = lookup_ns(queries, [tree](int value) {
+        return find(tree, value)->getValue();
+    });
+    delete_tree(tree);
+
+    Node* pool = create_tree_pool(input.data(), 0, size - 1);
+    double pool_ns = lookup_ns(queries, [pool](int value) {
+        return find(pool, value)->getValue();
+    });
+    delete_tree_pool(pool);
+
+    VebTree veb(input.data(), size);
+    double veb_ns = lookup_ns(queries, [&veb](int value) {
+        return veb.find(value);
+    });
+
+    std::cout << size << "," << tree_ns << "," << pool_ns << "," << veb_ns
+              << std::endl;
+}
+
 int main() {
     int counter = 0;
     if (!test_one_element()) {
@@ -95,6 +408,23 @@ int main() {
         std::cout << "Even elements test failed!" << std::endl;
         counter++;
     }
+    if (!test_pool_same_tree()) {
+        std::cout << "Pool same tree test failed!" << std::endl;
+        counter++;
+    }
+    if (!test_veb_layout()) {
+        std::cout << "Veb layout test failed!" << std::endl;
+        counter++;
+    }
+    if (!test_veb_find()) {
+        std::cout << "Veb find test failed!" << std::endl;
+        counter++;
+    }
     std::cout << counter << " tests failed." << std::endl;
+
+    std::cout << "values,tree_ns,pool_ns,veb_ns" << std::endl;
+    for (int size = 1 << 10; size <= 1 << 25; size <<= 3) {
+        benchmark(size, 5000000);
+    }
 }
 
@@ -1,7 +1,19 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
 #include <iostream>
 #include <list>
+#include <new>
+#include <thread>
 #include <vector>
 
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
 // Task description: Given a binary tree, design an algorithm to create one
 // linked list for each level, containing all the nodes at that depth.
 //
@@ -20,6 +32,35 @@
 // visit all elements in the binary tree and add each one to the correct list.
 // This approach also has O(N) runtime complexity, but its space complexity is
 // O(logN) for balanced trees, as each recursion uses space in the stack.
+//
+// Allocating a list node per tree node costs both time and memory on large
+// trees. Method tree_to_levels() instead writes all nodes in breadth first
+// order into a single array, along with the offset of each level in it. The
+// array is its own queue: the frontier is the range of the last level, and
+// the children of its nodes are appended to form the next one. The levels
+// list the nodes from left to right.
+//
+// Method tree_to_levels_parallel() expands wide levels on several threads.
+// The frontier is split into one chunk per thread, and each thread first
+// counts the children of its chunk. The running sum of the counts tells each
+// thread where to write the children of its chunk, so the next level is
+// written in place without locks and in the same order.
+//
+// On a single core, for a balanced tree of 50M nodes (26 levels, ./a.out
+// 50000000), where the array of levels is a vector that grew to 2^26 pointers:
+//
+// | method                     | time (s)   | memory (MB) |
+// |----------------------------|------------|-------------|
+// | tree_to_lists              | 9.8 - 12.4 |        1600 |
+// | tree_to_levels             |  1.3 - 1.9 |         536 |
+// | tree_to_levels_parallel, 1 |  0.8 - 1.3 |         536 |
+// | tree_to_levels_parallel, 4 |  1.1 - 1.3 |         536 |
+//
+// With a single thread both level methods run the same code, and the spread
+// comes from the state of the heap after freeing 50M list nodes.
+//
+// Compile with: g++ -O2 -pthread binary_tree_to_lists.cpp
+// Run with: ./a.out [nodes, 5000000 by default] [threads]
 
 using namespace std;
 
@@ -66,6 +107,107 @@ vector< list<Node*> > tree_to_lists(Node* root) {
     return results;
 }
 
+// All nodes of a tree in breadth first order. Level i holds the nodes from
+// nodes[offsets[i]] up to, but not including, nodes[offsets[i + 1]].
+struct TreeLevels {
+    vector<Node*> nodes;
+    vector<size_t> offsets;
+
+    size_t levels() const { return offsets.size() - 1; }
+    size_t size(size_t level) const {
+        return offsets[level + 1] - offsets[level];
+    }
+    Node* const* level(size_t level) const { return &nodes[offsets[level]]; }
+};
+
+// Appends the children of the nodes in [start, end) to the array.
+void append_children(vector<Node*>& nodes, size_t start, size_t end) {
+    for (size_t i = start; i < end; i++) {
+        Node* node = nodes[i];
+        if (node->getLeft()) nodes.push_back(node->getLeft());
+        if (node->getRight()) nodes.push_back(node->getRight());
+    }
+}
+
+TreeLevels tree_to_levels(Node* root) {
+    TreeLevels result;
+    result.offsets.push_back(0);
+    if (root) result.nodes.push_back(root);
+
+    for (size_t start = 0; start < result.nodes.size(); ) {
+        size_t end = result.nodes.size();
+        result.offsets.push_back(end);
+        append_children(result.nodes, start, end);
+        start = end;
+    }
+    return result;
+}
+
+// Runs task(i) for each i in [0, tasks) on the given number of threads.
+void parallel_for(size_t tasks, int threads,
+                  const function<void(size_t)>& task) {
+    atomic<size_t> next(0);
+    auto work = [&]() {
+        for (size_t i = next++; i < tasks; i = next++) task(i);
+    };
+
+    vector<thread> workers;
+    for (int i = 1; i < threads; i++) workers.push_back(thread(work));
+    work();
+    for (thread& worker : workers) worker.join();
+}
+
+// Levels narrower than min_width are expanded on the calling thread. A thread
+// count below one is treated as one.
+TreeLevels tree_to_levels_parallel(Node* root, int threads,
+                                   size_t min_width = 1 << 16) {
+    threads = max(threads, 1);
+    TreeLevels result;
+    result.offsets.push_back(0);
+    if (root) result.nodes.push_back(root);
+
+    vector<size_t> counts(threads + 1);
+    for (size_t start = 0; start < result.nodes.size(); ) {
+        size_t end = result.nodes.size();
+        result.offsets.push_back(end);
+        if (threads == 1 || end - start < min_width) {
+            append_children(result.nodes, start, end);
+            start = end;
+            continue;
+        }
+
+        size_t chunk = (end - start + threads - 1) / threads;
+        parallel_for(threads, threads, [&](size_t part) {
+            size_t from = min(end, start + part * chunk);
+            size_t to = min(end, from + chunk);
+            size_t count = 0;
+            for (size_t i = from; i < to; i++) {
+                Node* node = result.nodes[i];
+                count += (node->getLeft() != 0) + (node->getRight() != 0);
+            }
+            counts[part + 1] = count;
+        });
+        counts[0] = end;
+        for (int part = 0; part < threads; part++) {
+            counts[part + 1] += counts[part];
+        }
+        result.nodes.resize(counts[threads]);
+
+        parallel_for(threads, threads, [&](size_t part) {
+            size_t from = min(end, start + part * chunk);
+            size_t to = min(end, from + chunk);
+            Node** out = result.nodes.data() + counts[part];
+            for (size_t i = from; i < to; i++) {
+                Node* node = result.nodes[i];
+                if (node->getLeft()) *out++ = node->getLeft();
+                if (node->getRight()) *out++ = node->getRight();
+            }
+        });
+        start = end;
+    }
+    return result;
+}
+
 bool test_one_level() {
     Node root(1, 0, 0);
 
@@ -105,7 +247,117 @@ bool test_three_levels() {
            4 == result.at(2).front()->getValue();
 }
 
-int main() {
+bool test_levels_one_level() {
+    Node root(1, 0, 0);
+
+    TreeLevels result = tree_to_levels(&root);
+    TreeLevels empty = tree_to_levels(0);
+    return 1 == result.levels() && 1 == result.size(0) &&
+           &root == result.level(0)[0] && 0 == empty.levels();
+}
+
+bool test_levels_three_levels() {
+    Node leftright(5, 0, 0);
+    Node rightleft(6, 0, 0);
+    Node left(2, 0, &leftright);
+    Node right(3, &rightleft, 0);
+    Node root(1, &left, &right);
+
+    TreeLevels result = tree_to_levels(&root);
+    Node* expected[] = { &root, &left, &right, &leftright, &rightleft };
+    size_t offsets[] = { 0, 1, 3, 5 };
+    return 3 == result.levels() &&
+           equal(result.nodes.begin(), result.nodes.end(), expected) &&
+           equal(result.offsets.begin(), result.offsets.end(), offsets);
+}
+
+// Builds a tree of random shape, making a node a leaf with probability 1/4.
+Node* create_random_tree(int depth, uint32_t& state, vector<Node*>& nodes) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    if (depth == 0 || state % 4 == 0) return 0;
+    Node* left = create_random_tree(depth - 1, state, nodes);
+    Node* right = create_random_tree(depth - 1, state, nodes);
+    nodes.push_back(new Node(nodes.size(), left, right));
+    return nodes.back();
+}
+
+bool test_levels_same_as_lists() {
+    bool ret = true;
+    uint32_t state = 42;
+    for (int i = 0; i < 200 && ret; i++) {
+        vector<Node*> nodes;
+        Node* root = create_random_tree(1 + i % 16, state, nodes);
+        vector< list<Node*> > lists = tree_to_lists(root);
+        TreeLevels levels = tree_to_levels(root);
+        ret = lists.size() == levels.levels() &&
+              levels.nodes.size() == nodes.size();
+
+        // The lists do not keep the nodes of a level from left to right.
+        for (size_t level = 0; level < lists.size() && ret; level++) {
+            vector<Node*> expected(lists[level].begin(), lists[level].end());
+            vector<Node*> actual(levels.level(level),
+                                 levels.level(level) + levels.size(level));
+            sort(expected.begin(), expected.end());
+            sort(actual.begin(), actual.end());
+            ret = expected == actual;
+        }
+        for (int threads = -1; threads <= 4 && ret; threads++) {
+            TreeLevels parallel = tree_to_levels_parallel(root, threads, 1);
+            ret = parallel.nodes == levels.nodes &&
+                  parallel.offsets == levels.offsets;
+        }
+        for (Node* node : nodes) delete node;
+    }
+    return ret;
+}
+
+double elapsed_sec(chrono::steady_clock::time_point start) {
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+// Bytes currently allocated on the heap, or 0 if unknown. mallinfo2() needs
+// glibc 2.33; the older mallinfo() reports int counters, which wrap above 4GB.
+size_t heap_bytes() {
+#ifdef __GLIBC__
+#if __GLIBC_PREREQ(2, 33)
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+#else
+    struct mallinfo info = mallinfo();
+    return (size_t) (unsigned) info.uordblks + (unsigned) info.hblkhd;
+#endif
+#else
+    return 0;
+#endif
+}
+
+// Builds a balanced tree over the values [start, end], in order in the pool.
+Node* create_balanced(Node* pool, int start, int end) {
+    if (start > end) return 0;
+    int middle = start + (end - start) / 2;
+    Node* left = create_balanced(pool, start, middle - 1);
+    Node* right = create_balanced(pool, middle + 1, end);
+    return new (pool + middle) Node(middle, left, right);
+}
+
+size_t level_count(const vector< list<Node*> >& lists) { return lists.size(); }
+size_t level_count(const TreeLevels& levels) { return levels.levels(); }
+
+template <typename F>
+void benchmark(const char* method, F to_levels) {
+    size_t before = heap_bytes();
+    auto start = chrono::steady_clock::now();
+    auto result = to_levels();
+    double sec = elapsed_sec(start);
+    size_t bytes = heap_bytes() - before;
+    cout << method << "," << level_count(result) << "," << sec << ","
+         << bytes / 1000000 << endl;
+}
+
+int main(int argc, char* argv[]) {
     int counter = 0;
     if (!test_one_level()) {
         cout << "One level test failed!" << endl;
@@ -119,6 +371,31 @@ int main() {
         cout << "Three levels test failed!" << endl;
         counter++;
     }
+    if (!test_levels_one_level()) {
+        cout << "Levels one level test failed!" << endl;
+        counter++;
+    }
+    if (!test_levels_three_levels()) {
+        cout << "Levels three levels test failed!" << endl;
+        counter++;
+    }
+    if (!test_levels_same_as_lists()) {
+        cout << "Levels same as lists test failed!" << endl;
+        counter++;
+    }
     cout << counter << " tests failed." << endl;
+
+    int size = argc > 1 ? atoi(argv[1]) : 5000000;
+    int threads = argc > 2 ? max(1, atoi(argv[2])) :
+                  max(1u, thread::hardware_concurrency());
+    Node* pool = static_cast<Node*>(::operator new(size * sizeof(Node)));
+    Node* root = create_balanced(pool, 0, size - 1);
+    cout << "method,levels,sec,memory_mb" << endl;
+    benchmark("tree_to_lists", [&]() { return tree_to_lists(root); });
+    benchmark("tree_to_levels", [&]() { return tree_to_levels(root); });
+    benchmark("tree_to_levels_parallel", [&]() {
+        return tree_to_levels_parallel(root, threads);
+    });
+    ::operator delete(pool);
 }
 
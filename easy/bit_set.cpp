@@ -1,10 +1,52 @@
+#include <chrono>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
+#include <stdexcept>
 
-#define INT_BITS 32
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#define WORD_BITS 64
+#define BLOCK_WORDS 8
 
 // Task description: Create a BitSet class that will be used to hold a given
 // number of bits in memory. The class should provide functionality to get, set
 // and unset each bit individually.
+//
+// Follow up: The BitSet is used to filter millions of row ids. Extend it with
+// count() to return the number of set bits, rank(i) to return the number of set
+// bits before position i, select(k) to return the position of the k-th set bit,
+// find_next(i) to iterate over set bits, as well as bulk and, or, xor and
+// andnot operations between two sets.
+//
+// Solution: The bits are stored in an array of 64 bit words, so that each word
+// operation processes twice as many bits as with int and the hardware popcount
+// and count trailing zeros instructions can be applied to a full word.
+//
+// count() simply sums the popcount of every word. find_next(i) masks off the
+// bits below i in the first word and then skips empty words, returning the
+// position of the lowest set bit of the first non empty word using ctz. This
+// makes iterating over a sparse set proportional to the number of words
+// rather than the number of bits.
+//
+// For rank and select a small auxiliary index is maintained, holding the
+// cumulative number of set bits before every block of 8 words (512 bits). This
+// costs 32 bits per 512 bits, i.e. 6.25% extra memory. rank(i) then requires a
+// single index lookup and at most 8 popcounts. select(k) binary searches the
+// index to locate the block, scans at most 8 words and finally locates the bit
+// within the word by repeatedly clearing the lowest set bit. The index is built
+// lazily on the first rank or select after a modification.
+//
+// The bulk operations process the words in chunks of four using 256 bit AVX2
+// instructions when available (compile with -mavx2) and fall back to a plain
+// word loop otherwise, which the compiler is also able to vectorize.
+//
+// Bounds checks in get(), set() and unset() are kept, but the code that
+// constructs and throws the exception is moved out of line, so that the check
+// itself is only a single well predicted branch. Bulk algorithms should
+// anyway prefer find_next() and the set operations over per bit access.
 
 using namespace std;
 
@@ -12,54 +54,207 @@ class BitSet {
 
     private:
         unsigned size;
-        int *bits;
+        unsigned words;
+        uint64_t *bits;
+        uint32_t *index;
+        bool index_valid;
+
+        void check(unsigned pos) const {
+            if (pos >= size) out_of_range_error();
+        }
+
+        [[noreturn]] static void out_of_range_error();
+        void check_same_size(const BitSet& other) const;
+        void build_index();
 
     public:
         BitSet(unsigned size);
+        BitSet(const BitSet& other);
+        BitSet& operator=(const BitSet& other);
         ~BitSet();
         bool get(unsigned pos);
         void set(unsigned pos);
         void unset(unsigned pos);
+
+        unsigned length() const { return size; }
+        unsigned count() const;
+        unsigned rank(unsigned pos);
+        unsigned select(unsigned k);
+        unsigned find_next(unsigned pos) const;
+
+        BitSet& operator&=(const BitSet& other);
+        BitSet& operator|=(const BitSet& other);
+        BitSet& operator^=(const BitSet& other);
+        BitSet& andnot(const BitSet& other);
 };
 
+void BitSet::out_of_range_error() {
+    throw out_of_range("Position is out of range");
+}
+
+void BitSet::check_same_size(const BitSet& other) const {
+    if (size != other.size) {
+        throw invalid_argument("BitSets have different sizes");
+    }
+}
+
 BitSet::BitSet(unsigned size) : size(size) {
-    bits = new int[size / INT_BITS + 1] { 0 };
+    words = (size + WORD_BITS - 1) / WORD_BITS;
+    bits = new uint64_t[words + 1] { 0 };
+    index = new uint32_t[words / BLOCK_WORDS + 2];
+    index_valid = false;
+}
+
+BitSet::BitSet(const BitSet& other) : size(other.size), words(other.words) {
+    bits = new uint64_t[words + 1];
+    memcpy(bits, other.bits, (words + 1) * sizeof(uint64_t));
+    index = new uint32_t[words / BLOCK_WORDS + 2];
+    index_valid = false;
+}
+
+BitSet& BitSet::operator=(const BitSet& other) {
+    if (this == &other) return *this;
+
+    BitSet copy(other);
+    swap(size, copy.size);
+    swap(words, copy.words);
+    swap(bits, copy.bits);
+    swap(index, copy.index);
+    index_valid = false;
+    return *this;
 }
 
 BitSet::~BitSet() {
-    delete(bits);
+    delete[] bits;
+    delete[] index;
 }
 
 bool BitSet::get(unsigned pos) {
-    if (pos >= size) {
-        throw out_of_range("Position is out of range");
-    }
-
-    int index = pos / INT_BITS;
-    int bit = pos % INT_BITS;
-    return (bits[index] & (1 << bit)) > 0;
+    check(pos);
+    return (bits[pos / WORD_BITS] >> (pos % WORD_BITS)) & 1;
 }
 
 void BitSet::set(unsigned pos) {
-    if (pos >= size) {
-        throw out_of_range("Position is out of range");
+    check(pos);
+    bits[pos / WORD_BITS] |= (uint64_t) 1 << (pos % WORD_BITS);
+    index_valid = false;
+}
+
+void BitSet::unset(unsigned pos) {
+    check(pos);
+    bits[pos / WORD_BITS] &= ~((uint64_t) 1 << (pos % WORD_BITS));
+    index_valid = false;
+}
+
+unsigned BitSet::count() const {
+    unsigned total = 0;
+    for (unsigned i = 0; i < words; i++) {
+        total += __builtin_popcountll(bits[i]);
     }
+    return total;
+}
 
-    int index = pos / INT_BITS;
-    int bit = pos % INT_BITS;
-    bits[index] = bits[index] | (1 << bit);
+// index[b] holds the number of set bits in all blocks before block b.
+void BitSet::build_index() {
+    unsigned total = 0;
+    for (unsigned i = 0; i < words; i++) {
+        if (i % BLOCK_WORDS == 0) index[i / BLOCK_WORDS] = total;
+        total += __builtin_popcountll(bits[i]);
+    }
+    index[(words + BLOCK_WORDS - 1) / BLOCK_WORDS] = total;
+    index_valid = true;
 }
 
-void BitSet::unset(unsigned pos) {
-    if (pos >= size) {
-        throw out_of_range("Position is out of range");
+// Returns the number of set bits in positions [0, pos).
+unsigned BitSet::rank(unsigned pos) {
+    if (pos > size) out_of_range_error();
+    if (!index_valid) build_index();
+
+    unsigned word = pos / WORD_BITS;
+    unsigned total = index[word / BLOCK_WORDS];
+    for (unsigned i = word / BLOCK_WORDS * BLOCK_WORDS; i < word; i++) {
+        total += __builtin_popcountll(bits[i]);
+    }
+    if (pos % WORD_BITS != 0) {
+        uint64_t mask = ((uint64_t) 1 << (pos % WORD_BITS)) - 1;
+        total += __builtin_popcountll(bits[word] & mask);
+    }
+    return total;
+}
+
+// Returns the position of the k-th set bit (starting from zero), or the size
+// of the set if there are not enough set bits.
+unsigned BitSet::select(unsigned k) {
+    if (!index_valid) build_index();
+
+    unsigned blocks = (words + BLOCK_WORDS - 1) / BLOCK_WORDS;
+    if (k >= index[blocks]) return size;
+
+    // Find the last block whose cumulative count is <= k.
+    unsigned lo = 0, hi = blocks - 1;
+    while (lo < hi) {
+        unsigned mid = (lo + hi + 1) / 2;
+        if (index[mid] <= k) lo = mid;
+        else hi = mid - 1;
     }
 
-    int index = pos / INT_BITS;
-    int bit = pos % INT_BITS;
-    bits[index] = bits[index] & ~(1 << bit);
+    k -= index[lo];
+    unsigned word = lo * BLOCK_WORDS;
+    while (true) {
+        unsigned ones = __builtin_popcountll(bits[word]);
+        if (k < ones) break;
+        k -= ones;
+        word++;
+    }
+
+    uint64_t value = bits[word];
+    for (unsigned i = 0; i < k; i++) value &= value - 1;
+    return word * WORD_BITS + __builtin_ctzll(value);
+}
+
+// Returns the position of the first set bit at or after pos, or the size of
+// the set if there is none.
+unsigned BitSet::find_next(unsigned pos) const {
+    if (pos >= size) return size;
+
+    unsigned word = pos / WORD_BITS;
+    uint64_t value = bits[word] & (~(uint64_t) 0 << (pos % WORD_BITS));
+    while (value == 0) {
+        if (++word >= words) return size;
+        value = bits[word];
+    }
+    return word * WORD_BITS + __builtin_ctzll(value);
 }
 
+#ifdef __AVX2__
+#define BULK_OP(name, vector_op, scalar_op)                                   \
+    BitSet& BitSet::name(const BitSet& other) {                              \
+        check_same_size(other);                                              \
+        unsigned i = 0;                                                      \
+        for (; i + 4 <= words; i += 4) {                                     \
+            __m256i a = _mm256_loadu_si256((__m256i*) (bits + i));           \
+            __m256i b = _mm256_loadu_si256((__m256i*) (other.bits + i));     \
+            _mm256_storeu_si256((__m256i*) (bits + i), vector_op);           \
+        }                                                                    \
+        for (; i < words; i++) bits[i] = scalar_op;                          \
+        index_valid = false;                                                 \
+        return *this;                                                        \
+    }
+#else
+#define BULK_OP(name, vector_op, scalar_op)                                   \
+    BitSet& BitSet::name(const BitSet& other) {                              \
+        check_same_size(other);                                              \
+        for (unsigned i = 0; i < words; i++) bits[i] = scalar_op;            \
+        index_valid = false;                                                 \
+        return *this;                                                        \
+    }
+#endif
+
+BULK_OP(operator&=, _mm256_and_si256(a, b), bits[i] & other.bits[i])
+BULK_OP(operator|=, _mm256_or_si256(a, b), bits[i] | other.bits[i])
+BULK_OP(operator^=, _mm256_xor_si256(a, b), bits[i] ^ other.bits[i])
+BULK_OP(andnot, _mm256_andnot_si256(b, a), bits[i] & ~other.bits[i])
+
 bool test_constructor() {
     BitSet bits(100);
     for (int i = 0; i < 100; i++) {
@@ -108,6 +303,152 @@ bool test_get_set_unset() {
     return !bits.get(10) && bits.get(20) && !bits.get(30);
 }
 
+bool test_count() {
+    BitSet bits(1000);
+    for (int i = 0; i < 1000; i += 3) bits.set(i);
+    bits.set(998);
+    return 335 == bits.count();
+}
+
+bool test_rank() {
+    BitSet bits(2000);
+    for (int i = 0; i < 2000; i += 2) bits.set(i);
+
+    for (int i = 0; i <= 2000; i++) {
+        if (bits.rank(i) != (unsigned) (i + 1) / 2) return false;
+    }
+    bits.unset(0);
+    return 999 == bits.rank(2000) && 0 == bits.rank(1);
+}
+
+bool test_select() {
+    BitSet bits(5000);
+    for (int i = 7; i < 5000; i += 7) bits.set(i);
+
+    for (unsigned k = 0; k < bits.count(); k++) {
+        unsigned pos = bits.select(k);
+        if (pos != 7 * (k + 1) || bits.rank(pos) != k) return false;
+    }
+    return 5000 == bits.select(bits.count());
+}
+
+bool test_find_next() {
+    BitSet bits(1000);
+    bits.set(3);
+    bits.set(64);
+    bits.set(65);
+    bits.set(999);
+
+    unsigned expected[] = { 3, 64, 65, 999 };
+    int i = 0;
+    for (unsigned pos = bits.find_next(0); pos < 1000;
+         pos = bits.find_next(pos + 1)) {
+        if (i >= 4 || pos != expected[i++]) return false;
+    }
+    return 4 == i;
+}
+
+bool test_set_algebra() {
+    BitSet a(1000), b(1000);
+    for (int i = 0; i < 1000; i += 2) a.set(i);
+    for (int i = 0; i < 1000; i += 3) b.set(i);
+
+    BitSet and_set(a), or_set(a), xor_set(a), andnot_set(a);
+    and_set &= b;
+    or_set |= b;
+    xor_set ^= b;
+    andnot_set.andnot(b);
+
+    for (int i = 0; i < 1000; i++) {
+        bool x = i % 2 == 0, y = i % 3 == 0;
+        if (and_set.get(i) != (x && y) || or_set.get(i) != (x || y) ||
+            xor_set.get(i) != (x != y) || andnot_set.get(i) != (x && !y)) {
+            return false;
+        }
+    }
+    return 167 == and_set.rank(1000);
+}
+
+bool test_set_algebra_size_mismatch() {
+    BitSet a(100), b(200);
+    try {
+        a &= b;
+        return false;
+    } catch (const invalid_argument& e) {
+        return true;
+    }
+}
+
+double seconds_since(chrono::steady_clock::time_point start) {
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+void run_benchmark(unsigned size) {
+    BitSet a(size), b(size);
+    for (unsigned i = 0; i < size; i += 3) a.set(i);
+    for (unsigned i = 0; i < size; i += 5) b.set(i);
+    double bytes = 3.0 * size / 8;
+
+    cout << "Benchmark on " << size << " bits:" << endl;
+
+    BitSet c(a);
+    auto start = chrono::steady_clock::now();
+    for (unsigned i = 0; i < size; i++) {
+        if (!b.get(i)) c.unset(i);
+    }
+    cout << "per bit and: " << bytes / seconds_since(start) / 1e9
+         << " GB/s" << endl;
+
+    c = a;
+    start = chrono::steady_clock::now();
+    c &= b;
+    cout << "and: " << bytes / seconds_since(start) / 1e9 << " GB/s" << endl;
+
+    c = a;
+    start = chrono::steady_clock::now();
+    c |= b;
+    cout << "or: " << bytes / seconds_since(start) / 1e9 << " GB/s" << endl;
+
+    c = a;
+    start = chrono::steady_clock::now();
+    c ^= b;
+    cout << "xor: " << bytes / seconds_since(start) / 1e9 << " GB/s" << endl;
+
+    c = a;
+    start = chrono::steady_clock::now();
+    c.andnot(b);
+    cout << "andnot: " << bytes / seconds_since(start) / 1e9 << " GB/s"
+         << endl;
+
+    start = chrono::steady_clock::now();
+    unsigned total = a.count();
+    cout << "count: " << size / 8 / seconds_since(start) / 1e9 << " GB/s ("
+         << total << " bits)" << endl;
+
+    unsigned found = 0;
+    start = chrono::steady_clock::now();
+    for (unsigned pos = b.find_next(0); pos < size; pos = b.find_next(pos + 1)) {
+        found++;
+    }
+    cout << "find_next: " << found / seconds_since(start) / 1e6
+         << " M bits/s" << endl;
+
+    unsigned sum = a.rank(size);
+    start = chrono::steady_clock::now();
+    for (unsigned i = 0; i < 1000000; i++) {
+        sum += a.rank((i * 2654435761u) % size);
+    }
+    cout << "rank: " << 1 / seconds_since(start) << " M queries/s" << endl;
+
+    start = chrono::steady_clock::now();
+    for (unsigned i = 0; i < 1000000; i++) {
+        sum += a.select((i * 2654435761u) % total);
+    }
+    cout << "select: " << 1 / seconds_since(start) << " M queries/s"
+         << (sum == 0 ? " " : "") << endl;
+}
+
 int main() {
     int counter = 0;
     if (!test_constructor()) {
@@ -130,6 +471,31 @@ int main() {
         cout << "BitSet test failed." << endl;
         counter++;
     }
+    if (!test_count()) {
+        cout << "BitSet count test failed." << endl;
+        counter++;
+    }
+    if (!test_rank()) {
+        cout << "BitSet rank test failed." << endl;
+        counter++;
+    }
+    if (!test_select()) {
+        cout << "BitSet select test failed." << endl;
+        counter++;
+    }
+    if (!test_find_next()) {
+        cout << "BitSet find next test failed." << endl;
+        counter++;
+    }
+    if (!test_set_algebra()) {
+        cout << "BitSet set algebra test failed." << endl;
+        counter++;
+    }
+    if (!test_set_algebra_size_mismatch()) {
+        cout << "BitSet set algebra size mismatch test failed." << endl;
+        counter++;
+    }
     cout << counter << " tests failed." << endl;
-}
 
+    run_benchmark(100000000);
+}
@@ -1,5 +1,10 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
 #include <iostream>
+#include <queue>
 #include <stack>
+#include <vector>
 
 // Task description: Write a class to stream a binary search tree in sorted
 // order using at most O(logN) storage, where N is the total number of nodes in
@@ -16,6 +21,47 @@
 // As soon as an element is popped, its right sub-tree is added to the stack.
 // Given two BSTs this class allows us to merge them in O(N + M) time and
 // O(logM + logN) space.
+//
+// MergeStream extends this to merging K trees, streaming all their nodes in
+// sorted order in O(N logK) time. It keeps one stream per tree and a loser
+// tree over the current nodes of all streams. Each internal node of the loser
+// tree holds the stream that lost the comparison at that node, and the overall
+// winner is kept separately. After the winner is popped and its stream
+// advanced, only the games on the path from its leaf to the root have to be
+// replayed, comparing the new node with the stored losers. This needs one
+// comparison per level, half as many as a binary heap, and no swaps of heap
+// entries. The losers are stored together with their keys, so that a replay
+// only reads one entry per level. Exhausted streams compare as larger than
+// any value.
+//
+// The streams use BufferedTreeStream, which performs the same traversal as
+// TreeStream, but keeps its stack in a slice of one buffer shared by all
+// streams. The slice of each stream has room for the height of its tree, so
+// that it never has to grow. Calling reset() streams a new set of trees and
+// only allocates if the buffers are too small. As the streams take turns in
+// random order, reading the next node of a stream is usually a cache miss.
+// Each stream therefore takes its next 16 nodes and their values from its
+// tree in one go, while the nodes of that part of the tree are in the cache.
+//
+// Consumers can either pop() one node at a time, or call next_n() to copy the
+// next block of nodes into their own buffer.
+//
+// Million nodes per second to merge 1000 trees of 10K random values each, on
+// a single core:
+//
+// +------------------------------+--------------+
+// | Method                       | Nodes/sec    |
+// +------------------------------+--------------+
+// | Flatten all and std::sort    |        11.1M |
+// | Binary heap of TreeStreams   |         3.3M |
+// | MergeStream, pop()           |         8.1M |
+// | MergeStream, next_n(256)     |         8.4M |
+// +------------------------------+--------------+
+//
+// Flattening and sorting is still faster, but needs memory for all N values,
+// while MergeStream only needs O(K logN) and can start streaming right away.
+//
+// Compile with: g++ -O2 bst_stream.cpp
 
 using namespace std;
 
@@ -65,6 +111,197 @@ class TreeStream {
         }
 };
 
+// Same traversal as TreeStream, with the stack in a buffer provided by the
+// caller, which must have room for at least height(root) nodes.
+class BufferedTreeStream {
+
+    private:
+        Node** s;
+        size_t size;
+
+        void add(Node* node) {
+            while (node != NULL) {
+                s[size++] = node;
+                node = node->getLeft();
+            }
+        }
+
+    public:
+        BufferedTreeStream() : s(NULL), size(0) { }
+
+        void reset(Node* root, Node** buffer) {
+            s = buffer;
+            size = 0;
+            add(root);
+        }
+
+        Node* top() const {
+            return size == 0 ? NULL : s[size - 1];
+        }
+
+        bool pop() {
+            if (size == 0) return false;
+
+            Node* temp = s[--size];
+            add(temp->getRight());
+            return true;
+        }
+};
+
+// Returns the number of levels of the tree, using an explicit stack.
+size_t height(Node* root) {
+    vector< pair<Node*, size_t> > nodes;
+    size_t max = 0;
+    if (root != NULL) nodes.push_back(make_pair(root, 1));
+    while (!nodes.empty()) {
+        Node* node = nodes.back().first;
+        size_t level = nodes.back().second;
+        nodes.pop_back();
+        if (level > max) max = level;
+        if (node->getLeft() != NULL) {
+            nodes.push_back(make_pair(node->getLeft(), level + 1));
+        }
+        if (node->getRight() != NULL) {
+            nodes.push_back(make_pair(node->getRight(), level + 1));
+        }
+    }
+    return max;
+}
+
+class MergeStream {
+
+    private:
+        static const int LOOKAHEAD = 16;
+
+        // The next nodes of a stream, taken from its tree in one go.
+        struct Lookahead {
+            Node* nodes[LOOKAHEAD];
+            int64_t keys[LOOKAHEAD];
+            int next;
+            int size;
+        };
+
+        // The loser of a game, with its key, so that replaying the game does
+        // not have to look up the key of the loser.
+        struct Loser {
+            int64_t key;
+            int stream;
+        };
+
+        vector<Node*> buffer;
+        vector<BufferedTreeStream> streams;
+        vector<Lookahead> lookahead;
+        vector<int64_t> keys;
+        vector<Loser> losers;
+        int leaves;
+        int winner;
+
+        void refill(int stream);
+        void advance(int stream);
+
+    public:
+        MergeStream(Node* roots[], int count, const size_t heights[] = NULL) {
+            reset(roots, count, heights);
+        }
+
+        void reset(Node* roots[], int count, const size_t heights[] = NULL);
+
+        Node* top() const {
+            const Lookahead& next = lookahead[winner];
+            return keys[winner] == INT64_MAX ? NULL : next.nodes[next.next];
+        }
+
+        bool pop();
+        size_t next_n(Node* out[], size_t n);
+};
+
+// Takes the next nodes of the given stream from its tree and sets its key.
+void MergeStream::refill(int stream) {
+    Lookahead& next = lookahead[stream];
+    next.next = 0;
+    next.size = 0;
+    for (Node* node = streams[stream].top(); node != NULL && next.size < LOOKAHEAD;
+         node = streams[stream].top()) {
+        next.nodes[next.size] = node;
+        next.keys[next.size++] = node->getValue();
+        streams[stream].pop();
+    }
+    keys[stream] = next.size == 0 ? INT64_MAX : next.keys[0];
+}
+
+// Starts streaming the given trees. If the heights of the trees are not
+// given, they are computed by traversing each tree.
+void MergeStream::reset(Node* roots[], int count, const size_t heights[]) {
+    leaves = 1;
+    while (leaves < count) leaves *= 2;
+
+    vector<size_t> offsets(count + 1, 0);
+    for (int i = 0; i < count; i++) {
+        offsets[i + 1] = offsets[i] +
+                         (heights != NULL ? heights[i] : height(roots[i]));
+    }
+    if (buffer.size() < offsets[count]) buffer.resize(offsets[count]);
+    streams.resize(leaves);
+    lookahead.resize(leaves);
+    keys.resize(leaves);
+    losers.resize(leaves);
+
+    for (int i = 0; i < leaves; i++) {
+        streams[i].reset(i < count ? roots[i] : NULL,
+                         buffer.data() + offsets[min(i, count)]);
+        refill(i);
+    }
+
+    // Play all games bottom up, remembering the winner of each game.
+    vector<int> winners(2 * leaves);
+    for (int i = 0; i < leaves; i++) winners[leaves + i] = i;
+    for (int node = leaves - 1; node >= 1; node--) {
+        int a = winners[2 * node], b = winners[2 * node + 1];
+        int lost = keys[a] <= keys[b] ? b : a;
+        winners[node] = keys[a] <= keys[b] ? a : b;
+        losers[node] = Loser{keys[lost], lost};
+    }
+    winner = winners[1];
+}
+
+// Advances the given stream, which must be the winner, and replays its games.
+inline void MergeStream::advance(int stream) {
+    Lookahead& next = lookahead[stream];
+    if (++next.next < next.size) {
+        keys[stream] = next.keys[next.next];
+    } else {
+        refill(stream);
+    }
+
+    int64_t key = keys[stream];
+    for (int node = (stream + leaves) / 2; node >= 1; node /= 2) {
+        Loser loser = losers[node];
+        if (loser.key < key) {
+            losers[node] = Loser{key, stream};
+            key = loser.key;
+            stream = loser.stream;
+        }
+    }
+    winner = stream;
+}
+
+bool MergeStream::pop() {
+    if (keys[winner] == INT64_MAX) return false;
+    advance(winner);
+    return true;
+}
+
+// Copies up to n next nodes into out and returns how many were copied.
+size_t MergeStream::next_n(Node* out[], size_t n) {
+    size_t copied = 0;
+    while (copied < n && keys[winner] != INT64_MAX) {
+        const Lookahead& next = lookahead[winner];
+        out[copied++] = next.nodes[next.next];
+        advance(winner);
+    }
+    return copied;
+}
+
 bool test_empty() {
     TreeStream stream(NULL);
     return NULL == stream.top() && !stream.pop();
@@ -95,6 +332,178 @@ bool test_tree() {
            NULL == stream.top() && !stream.pop();
 }
 
+Node* create_tree(int* array, int start, int end) {
+    if (end < start) return NULL;
+
+    int middle = start + (end - start) / 2;
+    Node* left = create_tree(array, start, middle - 1);
+    Node* right = create_tree(array, middle + 1, end);
+    return new Node(array[middle], left, right);
+}
+
+void delete_tree(Node* root) {
+    if (root == NULL) return;
+    delete_tree(root->getLeft());
+    delete_tree(root->getRight());
+    delete root;
+}
+
+bool test_buffered() {
+    Node leftleft(1, NULL, NULL);
+    Node left(2, &leftleft, NULL);
+    Node rightleft(4, NULL, NULL);
+    Node right(5, &rightleft, NULL);
+    Node root(3, &left, &right);
+
+    Node* buffer[3];
+    BufferedTreeStream stream;
+    stream.reset(&root, buffer);
+    bool ret = 3 == height(&root);
+    for (int i = 1; i <= 5; i++) {
+        ret = ret && i == stream.top()->getValue() && stream.pop();
+    }
+    ret = ret && NULL == stream.top() && !stream.pop();
+
+    stream.reset(&right, buffer);
+    return ret && 4 == stream.top()->getValue() && stream.pop() &&
+           5 == stream.top()->getValue() && stream.pop() &&
+           NULL == stream.top();
+}
+
+bool test_merge_empty() {
+    Node* roots[] = {NULL, NULL, NULL};
+    MergeStream stream(roots, 3);
+    Node* out[4];
+    return NULL == stream.top() && !stream.pop() && 0 == stream.next_n(out, 4);
+}
+
+bool test_merge() {
+    // Values i, i + 7, i + 14, ... for tree i, with one empty tree and one
+    // duplicate value.
+    vector<int> values[7];
+    vector<int> expected;
+    Node* roots[7];
+    for (int i = 0; i < 7; i++) {
+        for (int value = i; i != 3 && value < 100; value += 7) {
+            values[i].push_back(value);
+            expected.push_back(value);
+        }
+        roots[i] = create_tree(values[i].data(), 0, values[i].size() - 1);
+    }
+    values[6].insert(values[6].begin() + 2, 20);
+    expected.push_back(20);
+    delete_tree(roots[6]);
+    roots[6] = create_tree(values[6].data(), 0, values[6].size() - 1);
+    sort(expected.begin(), expected.end());
+
+    MergeStream stream(roots, 7);
+    bool ret = true;
+    for (int value : expected) {
+        ret = ret && value == stream.top()->getValue() && stream.pop();
+    }
+    ret = ret && NULL == stream.top() && !stream.pop();
+
+    // The same trees again, in blocks of 5 nodes.
+    stream.reset(roots, 7);
+    Node* out[5];
+    vector<int> streamed;
+    for (size_t n = stream.next_n(out, 5); n > 0; n = stream.next_n(out, 5)) {
+        for (size_t i = 0; i < n; i++) streamed.push_back(out[i]->getValue());
+    }
+
+    for (int i = 0; i < 7; i++) delete_tree(roots[i]);
+    return ret && expected == streamed;
+}
+
+double elapsed_sec(chrono::steady_clock::time_point start) {
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+void flatten(Node* root, vector<int>& values) {
+    if (root == NULL) return;
+    flatten(root->getLeft(), values);
+    values.push_back(root->getValue());
+    flatten(root->getRight(), values);
+}
+
+struct Compare {
+    bool operator()(TreeStream* a, TreeStream* b) const {
+        return a->top()->getValue() > b->top()->getValue();
+    }
+};
+
+void benchmark(int count, int size) {
+    vector<Node*> roots;
+    vector<size_t> heights;
+    vector<int> values(size);
+    uint32_t state = 42;
+    for (int i = 0; i < count; i++) {
+        for (int& value : values) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            value = state >> 1;
+        }
+        sort(values.begin(), values.end());
+        roots.push_back(create_tree(values.data(), 0, size - 1));
+        heights.push_back(height(roots.back()));
+    }
+    double nodes = (double) count * size / 1e6;
+    cout << "method,trees,nodes,mnodes_per_sec,checksum" << endl;
+
+    auto start = chrono::steady_clock::now();
+    vector<int> all;
+    for (Node* root : roots) flatten(root, all);
+    sort(all.begin(), all.end());
+    uint64_t checksum = 0;
+    for (size_t i = 0; i < all.size(); i++) checksum += i * all[i];
+    cout << "flatten_sort," << count << "," << all.size() << ","
+         << nodes / elapsed_sec(start) << "," << checksum << endl;
+
+    start = chrono::steady_clock::now();
+    priority_queue<TreeStream*, vector<TreeStream*>, Compare> heap;
+    for (Node* root : roots) heap.push(new TreeStream(root));
+    checksum = 0;
+    for (uint64_t i = 0; !heap.empty(); i++) {
+        TreeStream* stream = heap.top();
+        heap.pop();
+        checksum += i * stream->top()->getValue();
+        stream->pop();
+        if (stream->top() != NULL) {
+            heap.push(stream);
+        } else {
+            delete stream;
+        }
+    }
+    cout << "heap_of_streams," << count << "," << all.size() << ","
+         << nodes / elapsed_sec(start) << "," << checksum << endl;
+
+    MergeStream merged(roots.data(), count, heights.data());
+    start = chrono::steady_clock::now();
+    merged.reset(roots.data(), count, heights.data());
+    checksum = 0;
+    for (uint64_t i = 0; merged.top() != NULL; i++, merged.pop()) {
+        checksum += i * merged.top()->getValue();
+    }
+    cout << "loser_tree_pop," << count << "," << all.size() << ","
+         << nodes / elapsed_sec(start) << "," << checksum << endl;
+
+    start = chrono::steady_clock::now();
+    merged.reset(roots.data(), count, heights.data());
+    Node* block[256];
+    checksum = 0;
+    uint64_t i = 0;
+    for (size_t n = merged.next_n(block, 256); n > 0;
+         n = merged.next_n(block, 256)) {
+        for (size_t j = 0; j < n; j++) checksum += i++ * block[j]->getValue();
+    }
+    cout << "loser_tree_next_n," << count << "," << all.size() << ","
+         << nodes / elapsed_sec(start) << "," << checksum << endl;
+
+    for (Node* root : roots) delete_tree(root);
+}
+
 int main() {
     int counter = 0;
     if (!test_empty()) {
@@ -109,6 +518,20 @@ int main() {
         std::cout << "Tree stream test failed!" << std::endl;
         counter++;
     }
+    if (!test_buffered()) {
+        std::cout << "Buffered stream test failed!" << std::endl;
+        counter++;
+    }
+    if (!test_merge_empty()) {
+        std::cout << "Merge empty streams test failed!" << std::endl;
+        counter++;
+    }
+    if (!test_merge()) {
+        std::cout << "Merge streams test failed!" << std::endl;
+        counter++;
+    }
     std::cout << counter << " tests failed." << std::endl;
+
+    benchmark(1000, 10000);
 }
 
@@ -1,5 +1,14 @@
 #include <iostream>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <thread>
+#include <utility>
+#include <vector>
 
 // Task description: Given the root of a binary tree, write a method to
 // determine whether the tree is balanced. A balanced binary tree is a tree
@@ -25,6 +34,39 @@
 // height(). The runtime complexity of this approach is O(N) since each node is
 // touched only once. The space complexity is O(D) where D is the depth of the
 // tree. This space is required for the recursive stack.
+//
+// On a degenerate tree D is close to N and the recursion overflows the call
+// stack. Methods is_balanced_iterative() and is_balanced2_iterative() compute
+// the heights in postorder with an explicit stack instead: the path from the
+// root to the current node, and the heights of the finished subtrees whose
+// parents are still on the path. They still need O(D) space, but on the heap.
+//
+// Method is_balanced_parallel() splits the top of the tree breadth first into
+// a few subtrees per thread and computes their heights in parallel, as in
+// height2(). Walking the split nodes bottom up, each one combines the heights
+// of its children with the same rule. The threads stop picking up subtrees
+// once one of them is not balanced. A degenerate tree does not get wider near
+// the top, so the split gives up after a few levels and a single subtree
+// holds most of the tree.
+//
+// For trees of 100M nodes (./a.out 100000000; -: call stack overflow), on a
+// single core, so the threads only add the cost of the split:
+//
+// | method                    | balanced (s) | degenerate (s) |
+// |---------------------------|--------------|----------------|
+// | is_balanced               |         8.26 |              - |
+// | is_balanced2              |         1.11 |              - |
+// | is_balanced_iterative     |        12.34 |           0.46 |
+// | is_balanced2_iterative    |         1.27 |           2.39 |
+// | is_balanced_parallel, 1   |         1.17 |           1.58 |
+// | is_balanced_parallel, 4   |         1.17 |           1.93 |
+//
+// On the degenerate tree is_balanced_iterative() gives up after measuring the
+// subtree of the root, while the others keep the whole path of 100M nodes on
+// the stack before the first imbalance shows up at the bottom.
+//
+// Compile with: g++ -O2 -pthread check_tree_balanced.cpp
+// Run with: ./a.out [nodes, 10000000 by default] [threads]
 
 class Node {
 
@@ -75,6 +117,168 @@ bool is_balanced2(Node* node) {
     return height2(node) != -1;
 }
 
+// Same as height(), using the given explicit stack of (node, depth) pairs
+// instead of recursion. The height is the greatest depth of any leaf. Only
+// the right children of nodes with two children wait on the stack, and the
+// stack keeps its size between calls so that it rarely needs to grow.
+int height_iterative(Node* root, std::vector< std::pair<Node*, int> >& stack) {
+    if (!root) return 0;
+
+    if (stack.size() < 64) stack.resize(64);
+    size_t size = 0;
+    int height = 0;
+    Node* node = root;
+    int depth = 1;
+    while (true) {
+        Node* left = node->getLeft();
+        Node* right = node->getRight();
+        if (left && right) {
+            if (size == stack.size()) stack.resize(2 * size);
+            stack[size++] = std::make_pair(right, depth + 1);
+        }
+        if (left || right) {
+            node = left ? left : right;
+            depth++;
+            continue;
+        }
+
+        height = std::max(height, depth);
+        if (size == 0) return height;
+        size--;
+        node = stack[size].first;
+        depth = stack[size].second;
+    }
+}
+
+// Same as height2(), computing the heights in postorder with an explicit stack
+// holding the path from the root to the current node, and the heights of the
+// finished subtrees whose parents are still on the path.
+int height2_iterative(Node* root) {
+    std::vector<Node*> path;
+    std::vector<int> heights;
+    Node* node = root;
+    Node* last = 0;
+    while (node || !path.empty()) {
+        if (node) {
+            path.push_back(node);
+            node = node->getLeft();
+            continue;
+        }
+
+        Node* top = path.back();
+        if (top->getRight() && top->getRight() != last) {
+            node = top->getRight();
+            continue;
+        }
+        path.pop_back();
+        int height_right = 0, height_left = 0;
+        if (top->getRight()) {
+            height_right = heights.back();
+            heights.pop_back();
+        }
+        if (top->getLeft()) {
+            height_left = heights.back();
+            heights.pop_back();
+        }
+        if (abs(height_left - height_right) > 1) return -1;
+        heights.push_back(std::max(height_left, height_right) + 1);
+        last = top;
+    }
+    return heights.empty() ? 0 : heights.back();
+}
+
+// Same as is_balanced(), using explicit stacks instead of recursion.
+bool is_balanced_iterative(Node* root) {
+    std::vector<Node*> stack;
+    std::vector< std::pair<Node*, int> > height_stack;
+    if (root) stack.push_back(root);
+    while (!stack.empty()) {
+        Node* node = stack.back();
+        stack.pop_back();
+
+        int height_left = height_iterative(node->getLeft(), height_stack);
+        int height_right = height_iterative(node->getRight(), height_stack);
+        if (abs(height_left - height_right) > 1) return false;
+        if (node->getRight()) stack.push_back(node->getRight());
+        if (node->getLeft()) stack.push_back(node->getLeft());
+    }
+    return true;
+}
+
+// Same as is_balanced2(), using explicit stacks instead of recursion.
+bool is_balanced2_iterative(Node* node) {
+    return height2_iterative(node) != -1;
+}
+
+// Runs task(i) for each i in [0, tasks) on the given number of threads.
+void parallel_for(size_t tasks, int threads,
+                  const std::function<void(size_t)>& task) {
+    std::atomic<size_t> next(0);
+    auto work = [&]() {
+        for (size_t i = next++; i < tasks; i = next++) task(i);
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 1; i < threads; i++) workers.push_back(std::thread(work));
+    work();
+    for (std::thread& worker : workers) worker.join();
+}
+
+// A node at the top of the tree, with the indexes of its children among the
+// parts of the split, or -1 if it has no such child.
+struct Part {
+    Node* node;
+    int left;
+    int right;
+};
+
+// Splits the top of the tree breadth first until there are at least the given
+// number of subtrees, or the tree does not get any wider. The first expanded
+// parts are the top of the tree and the rest are the roots of the subtrees.
+std::vector<Part> split_top(Node* root, size_t subtrees, size_t& expanded) {
+    std::vector<Part> parts;
+    if (root) parts.push_back({ root, -1, -1 });
+    expanded = 0;
+    while (expanded < parts.size() && parts.size() - expanded < subtrees &&
+           expanded < 4 * subtrees) {
+        Node* node = parts[expanded].node;
+        if (node->getLeft()) {
+            parts[expanded].left = parts.size();
+            parts.push_back({ node->getLeft(), -1, -1 });
+        }
+        if (node->getRight()) {
+            parts[expanded].right = parts.size();
+            parts.push_back({ node->getRight(), -1, -1 });
+        }
+        expanded++;
+    }
+    return parts;
+}
+
+// Same as is_balanced2(), computing the heights of subtrees on the given
+// number of threads. A thread count below one is treated as one.
+bool is_balanced_parallel(Node* root, int threads) {
+    threads = std::max(threads, 1);
+    size_t expanded;
+    std::vector<Part> parts = split_top(root, 8 * threads, expanded);
+    std::vector<int> heights(parts.size());
+    std::atomic<bool> failed(false);
+    parallel_for(parts.size() - expanded, threads, [&](size_t i) {
+        if (failed) return;
+        heights[expanded + i] = height2_iterative(parts[expanded + i].node);
+        if (heights[expanded + i] == -1) failed = true;
+    });
+    if (failed) return false;
+
+    for (size_t i = expanded; i-- > 0; ) {
+        int height_left = parts[i].left == -1 ? 0 : heights[parts[i].left];
+        int height_right = parts[i].right == -1 ? 0 : heights[parts[i].right];
+        if (abs(height_left - height_right) > 1) return false;
+        heights[i] = std::max(height_left, height_right) + 1;
+    }
+    return true;
+}
+
 bool test_tree_one_node() {
     Node root(1, 0, 0);
 
@@ -102,7 +306,109 @@ bool test_tree_not_balanced() {
            !is_balanced2(&root);
 }
 
-int main() {
+// Builds a tree of the given size, splitting the nodes between the subtrees
+// evenly give or take a random skew.
+Node* create_random_tree(int size, int skew, uint32_t& state,
+                         std::vector<Node*>& nodes) {
+    if (size == 0) return 0;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    int left_size = (size - 1) / 2 + (int) (state % (2 * skew + 1)) - skew;
+    left_size = std::max(0, std::min(size - 1, left_size));
+    Node* left = create_random_tree(left_size, skew, state, nodes);
+    Node* right = create_random_tree(size - 1 - left_size, skew, state, nodes);
+    nodes.push_back(new Node(size, left, right));
+    return nodes.back();
+}
+
+bool test_tree_iterative_parallel() {
+    bool ret = is_balanced_iterative(0) && is_balanced2_iterative(0) &&
+               is_balanced_parallel(0, 4);
+    int balanced = 0;
+    uint32_t state = 42;
+    for (int i = 0; i < 3000 && ret; i++) {
+        std::vector<Node*> nodes;
+        Node* root = create_random_tree(1 + i % 300, i % 3, state, nodes);
+        bool expected = is_balanced2(root);
+        balanced += expected;
+        ret = is_balanced(root) == expected &&
+              is_balanced_iterative(root) == expected &&
+              is_balanced2_iterative(root) == expected &&
+              height2_iterative(root) == height2(root);
+        std::vector< std::pair<Node*, int> > stack;
+        ret = ret && height_iterative(root, stack) == height(root);
+        for (int threads = -1; threads <= 4; threads++) {
+            ret = ret && is_balanced_parallel(root, threads) == expected;
+        }
+        for (Node* node : nodes) delete node;
+    }
+    return ret && balanced > 1000 && balanced < 2000;
+}
+
+bool test_tree_deep() {
+    const int size = 1000000;
+    std::vector<Node*> nodes;
+    Node* root = 0;
+    for (int i = 0; i < size; i++) {
+        root = i % 2 ? new Node(i, root, 0) : new Node(i, 0, root);
+        nodes.push_back(root);
+    }
+    std::vector< std::pair<Node*, int> > stack;
+    bool ret = height_iterative(root, stack) == size &&
+               !is_balanced_iterative(root) &&
+               !is_balanced2_iterative(root) &&
+               !is_balanced_parallel(root, 4);
+    for (Node* node : nodes) delete node;
+    return ret;
+}
+
+double elapsed_sec(std::chrono::steady_clock::time_point start) {
+    std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+// Builds a balanced tree over the values [start, end], in order in the pool.
+Node* create_balanced(Node* pool, int start, int end) {
+    if (start > end) return 0;
+    int middle = start + (end - start) / 2;
+    Node* left = create_balanced(pool, start, middle - 1);
+    Node* right = create_balanced(pool, middle + 1, end);
+    return new (pool + middle) Node(middle, left, right);
+}
+
+// Builds a tree in which every node only has a right child.
+Node* create_degenerate(Node* pool, int size) {
+    Node* root = 0;
+    for (int i = size - 1; i >= 0; i--) root = new (pool + i) Node(i, 0, root);
+    return root;
+}
+
+void benchmark(const char* shape, Node* root, int threads, bool recursive) {
+    auto run = [&](const char* method, const std::function<bool()>& check) {
+        auto start = std::chrono::steady_clock::now();
+        bool balanced = check();
+        std::cout << shape << "," << method << "," << balanced << ","
+                  << elapsed_sec(start) << std::endl;
+    };
+    if (recursive) {
+        run("is_balanced", [&]() { return is_balanced(root); });
+        run("is_balanced2", [&]() { return is_balanced2(root); });
+    }
+    run("is_balanced_iterative", [&]() { return is_balanced_iterative(root); });
+    run("is_balanced2_iterative", [&]() {
+        return is_balanced2_iterative(root);
+    });
+    run("is_balanced_parallel_1", [&]() {
+        return is_balanced_parallel(root, 1);
+    });
+    run("is_balanced_parallel", [&]() {
+        return is_balanced_parallel(root, threads);
+    });
+}
+
+int main(int argc, char* argv[]) {
     int counter = 0;
     if (!test_tree_one_node()) {
         std::cout << "One node tree test failed!" << std::endl;
@@ -116,6 +422,23 @@ int main() {
         std::cout << "Tree not balanced test failed!" << std::endl;
         counter++;
     }
+    if (!test_tree_iterative_parallel()) {
+        std::cout << "Tree iterative and parallel test failed!" << std::endl;
+        counter++;
+    }
+    if (!test_tree_deep()) {
+        std::cout << "Deep tree test failed!" << std::endl;
+        counter++;
+    }
     std::cout << counter << " tests failed." << std::endl;
+
+    int size = argc > 1 ? std::atoi(argv[1]) : 10000000;
+    int threads = argc > 2 ? std::max(1, std::atoi(argv[2])) :
+                  std::max(1u, std::thread::hardware_concurrency());
+    Node* pool = static_cast<Node*>(::operator new(size * sizeof(Node)));
+    std::cout << "tree,method,balanced,sec" << std::endl;
+    benchmark("balanced", create_balanced(pool, 0, size - 1), threads, true);
+    benchmark("degenerate", create_degenerate(pool, size), threads, false);
+    ::operator delete(pool);
 }
 
@@ -1,4 +1,11 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
 #include <iostream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 // Task description: Given the root node and two other nodes of a binary tree,
 // design an algorithm that will identify the first common ancestor of the
@@ -23,6 +30,60 @@
 // to its parent. In this case we would start from one of the given nodes, move
 // upwards and in each iteration check whether the other subtree contains the
 // second node.
+//
+// When answering millions of queries on a tree that does not change, it pays
+// off to preprocess the tree once. FlatTree flattens the tree into arrays in
+// preorder, using an explicit stack: for node i it holds the Node, the index
+// of its parent and its depth. Ancestors always come before their descendants
+// in preorder. A sorted array of (Node*, index) pairs maps nodes to indices.
+// Two indexes are built on top of it:
+//
+// (1) EulerLca records the Euler tour of the tree, i.e. the sequence of nodes
+//     visited by a depth first traversal, listing each node again every time
+//     the traversal returns to it from a child. The tour is generated from
+//     the preorder, by walking up the parents from each node to the parent of
+//     the next one. The lowest common ancestor of x and y is the shallowest
+//     node of the tour between the first visits of x and y. As all these
+//     nodes are descendants of the common ancestor, it is also the node with
+//     the smallest preorder index, so there is no need to compare depths. A
+//     sparse table holds the minimum of each range of the tour whose length
+//     is a power of two, so that the minimum of any range is the smaller of
+//     two overlapping ranges: O(1) per query, O(N logN) memory and time to
+//     build.
+//
+// (2) LiftingLca stores for each node its ancestors 1, 2, 4, ... levels above
+//     it, next to each other. A query lifts the deeper node to the depth of
+//     the other one, and then lifts both nodes by decreasing powers of two as
+//     long as their ancestors differ. This needs O(N logD) memory, where D is
+//     the depth of the tree, and O(logD) time per query.
+//
+// When all pairs are known up front, common_ancestors() answers them in a
+// single depth first traversal with an explicit stack, following Tarjan's
+// offline algorithm. Every node joins a union-find set when it is visited,
+// and once its subtree is done its set is linked to its parent. The root of
+// the set of a visited node is therefore its lowest ancestor still on the
+// stack. When the traversal leaves x, the common ancestor of x and every
+// node y it has already left is the root of the set of y. Path compression
+// keeps the total cost close to O(N + Q) for Q pairs, with no index to keep
+// around afterwards.
+//
+// On a random tree of 10M nodes (depth 59) on a single core, for queries
+// given as preorder indexes and as Node pointers (two binary searches):
+//
+// | method           | build (s) | memory (MB) | index q/s | node q/s |
+// |------------------|-----------|-------------|-----------|----------|
+// | common_ancestor  |         - |           - |         - |      2.6 |
+// | common_ancestors |         - |           - |         - |     169K |
+// | FlatTree         |      2.00 |         320 |         - |        - |
+// | EulerLca         |      2.59 |        1905 |      9.3M |     418K |
+// | LiftingLca       |      0.23 |         240 |      2.8M |     369K |
+//
+// A batch of 1M pairs takes 5.9s with common_ancestors(), against an
+// estimated 4.4 days calling common_ancestor() for each pair, and 7s to
+// flatten the tree, build EulerLca and look up the pairs.
+//
+// Compile with: g++ -O2 common_ancestor.cpp
+// Run with: ./a.out [nodes]
 
 class Node {
 
@@ -62,6 +123,250 @@ Node* common_ancestor(Node* root, Node* x, Node* y) {
     return 0;
 }
 
+// The tree flattened in preorder.
+struct FlatTree {
+    std::vector<Node*> nodes;
+    std::vector<int> parent;
+    std::vector<int> depth;
+    std::vector< std::pair<Node*, int> > lookup;
+
+    FlatTree(Node* root);
+    int index(Node* node) const;
+};
+
+FlatTree::FlatTree(Node* root) {
+    std::vector< std::pair<Node*, int> > stack;
+    if (root != 0) stack.push_back(std::make_pair(root, -1));
+    while (!stack.empty()) {
+        Node* node = stack.back().first;
+        int above = stack.back().second;
+        stack.pop_back();
+
+        int current = nodes.size();
+        nodes.push_back(node);
+        parent.push_back(above);
+        depth.push_back(above == -1 ? 0 : depth[above] + 1);
+        if (node->getRight() != 0) {
+            stack.push_back(std::make_pair(node->getRight(), current));
+        }
+        if (node->getLeft() != 0) {
+            stack.push_back(std::make_pair(node->getLeft(), current));
+        }
+    }
+
+    lookup.resize(nodes.size());
+    for (size_t i = 0; i < nodes.size(); i++) {
+        lookup[i] = std::make_pair(nodes[i], (int) i);
+    }
+    std::sort(lookup.begin(), lookup.end());
+}
+
+// Returns the preorder index of the node, or throws if it is not in the tree.
+int FlatTree::index(Node* node) const {
+    auto it = std::lower_bound(lookup.begin(), lookup.end(),
+                               std::make_pair(node, -1));
+    if (it == lookup.end() || it->first != node) {
+        throw "One or both nodes do not exist in the tree.";
+    }
+    return it->second;
+}
+
+class EulerLca {
+
+    private:
+        const FlatTree& tree;
+        std::vector<int> first;
+        std::vector< std::vector<int> > table;
+
+    public:
+        EulerLca(const FlatTree& tree);
+        int lca(int x, int y) const;
+        Node* lca(Node* x, Node* y) const {
+            return tree.nodes[lca(tree.index(x), tree.index(y))];
+        }
+        size_t bytes() const;
+};
+
+EulerLca::EulerLca(const FlatTree& tree) : tree(tree) {
+    int size = tree.nodes.size();
+    first.resize(size);
+    table.resize(1);
+    if (size == 0) return;
+
+    std::vector<int>& tour = table[0];
+    tour.reserve(2 * size - 1);
+    tour.push_back(0);
+    for (int i = 1; i < size; i++) {
+        for (int up = i - 1; up != tree.parent[i]; ) {
+            up = tree.parent[up];
+            tour.push_back(up);
+        }
+        first[i] = tour.size();
+        tour.push_back(i);
+    }
+    for (int up = size - 1; up != 0; ) {
+        up = tree.parent[up];
+        tour.push_back(up);
+    }
+
+    size_t tour_size = tour.size();
+    for (size_t length = 2; length <= tour_size; length *= 2) {
+        const std::vector<int>& below = table.back();
+        std::vector<int> level(tour_size - length + 1);
+        for (size_t i = 0; i < level.size(); i++) {
+            level[i] = std::min(below[i], below[i + length / 2]);
+        }
+        table.push_back(std::move(level));
+    }
+}
+
+// Returns the preorder index of the lowest common ancestor of the nodes with
+// the given preorder indexes.
+int EulerLca::lca(int x, int y) const {
+    int from = first[x], to = first[y];
+    if (from > to) std::swap(from, to);
+    int level = 31 - __builtin_clz(to - from + 1);
+    return std::min(table[level][from], table[level][to - (1 << level) + 1]);
+}
+
+size_t EulerLca::bytes() const {
+    size_t total = first.size() * sizeof(int);
+    for (const std::vector<int>& level : table) total += level.size() * sizeof(int);
+    return total;
+}
+
+class LiftingLca {
+
+    private:
+        const FlatTree& tree;
+        int levels;
+        std::vector<int> up;
+
+    public:
+        LiftingLca(const FlatTree& tree);
+        int lca(int x, int y) const;
+        Node* lca(Node* x, Node* y) const {
+            return tree.nodes[lca(tree.index(x), tree.index(y))];
+        }
+        size_t bytes() const { return up.size() * sizeof(int); }
+};
+
+LiftingLca::LiftingLca(const FlatTree& tree) : tree(tree), levels(1) {
+    int size = tree.nodes.size();
+    int max_depth = 0;
+    for (int depth : tree.depth) max_depth = std::max(max_depth, depth);
+    while ((1 << levels) <= max_depth) levels++;
+
+    // As parents come before their children, their ancestors are complete by
+    // the time they are needed. The root is its own ancestor.
+    up.resize((size_t) size * levels);
+    for (int i = 0; i < size; i++) {
+        int* ancestors = &up[(size_t) i * levels];
+        ancestors[0] = i == 0 ? 0 : tree.parent[i];
+        for (int k = 1; k < levels; k++) {
+            ancestors[k] = up[(size_t) ancestors[k - 1] * levels + k - 1];
+        }
+    }
+}
+
+int LiftingLca::lca(int x, int y) const {
+    if (tree.depth[x] < tree.depth[y]) std::swap(x, y);
+    for (int diff = tree.depth[x] - tree.depth[y], k = 0; diff > 0;
+         diff >>= 1, k++) {
+        if (diff & 1) x = up[(size_t) x * levels + k];
+    }
+    if (x == y) return x;
+
+    for (int k = levels - 1; k >= 0; k--) {
+        int above_x = up[(size_t) x * levels + k];
+        int above_y = up[(size_t) y * levels + k];
+        if (above_x != above_y) {
+            x = above_x;
+            y = above_y;
+        }
+    }
+    return up[(size_t) x * levels];
+}
+
+// Returns the first common ancestor of each pair of nodes, or throws if a node
+// is not in the tree.
+std::vector<Node*> common_ancestors(
+        Node* root, const std::vector< std::pair<Node*, Node*> >& pairs) {
+    // Group the pairs by node, so that each node finds its pairs in one hash
+    // lookup when the traversal leaves it.
+    std::unordered_map<Node*, int> query_nodes;
+    std::vector<int> ends(2 * pairs.size());
+    for (size_t i = 0; i < pairs.size(); i++) {
+        Node* ends_of_pair[] = { pairs[i].first, pairs[i].second };
+        for (int j = 0; j < 2; j++) {
+            auto it = query_nodes.emplace(ends_of_pair[j], query_nodes.size());
+            ends[2 * i + j] = it.first->second;
+        }
+    }
+    std::vector<int> offsets(query_nodes.size() + 1, 0);
+    for (int end : ends) offsets[end + 1]++;
+    for (size_t i = 1; i < offsets.size(); i++) offsets[i] += offsets[i - 1];
+    std::vector<int> queries(ends.size());
+    std::vector<int> next(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < ends.size(); i++) queries[next[ends[i]]++] = i;
+
+    // Index in preorder of each query node, set when the traversal leaves it.
+    std::vector<int> left(query_nodes.size(), -1);
+    std::vector<Node*> nodes;
+    std::vector<int> sets;
+    std::vector<int> answers(pairs.size(), -1);
+
+    struct Frame { Node* node; int index; int parent; };
+    std::vector<Frame> stack;
+    if (root != 0) stack.push_back({ root, -1, -1 });
+    while (!stack.empty()) {
+        Frame frame = stack.back();
+        stack.pop_back();
+        if (frame.index == -1) {
+            frame.index = nodes.size();
+            nodes.push_back(frame.node);
+            sets.push_back(frame.index);
+            stack.push_back(frame);
+            if (frame.node->getRight() != 0) {
+                stack.push_back({ frame.node->getRight(), -1, frame.index });
+            }
+            if (frame.node->getLeft() != 0) {
+                stack.push_back({ frame.node->getLeft(), -1, frame.index });
+            }
+            continue;
+        }
+
+        auto it = query_nodes.find(frame.node);
+        if (it != query_nodes.end()) {
+            int current = it->second;
+            left[current] = frame.index;
+            for (int i = offsets[current]; i < offsets[current + 1]; i++) {
+                int other = left[ends[queries[i] ^ 1]];
+                if (other == -1) continue;
+
+                int set = other;
+                while (sets[set] != set) set = sets[set];
+                while (sets[other] != set) {
+                    int above = sets[other];
+                    sets[other] = set;
+                    other = above;
+                }
+                answers[queries[i] / 2] = set;
+            }
+        }
+        if (frame.parent != -1) sets[frame.index] = frame.parent;
+    }
+
+    std::vector<Node*> ancestors(pairs.size());
+    for (size_t i = 0; i < pairs.size(); i++) {
+        if (answers[i] == -1) {
+            throw "One or both nodes do not exist in the tree.";
+        }
+        ancestors[i] = nodes[answers[i]];
+    }
+    return ancestors;
+}
+
 bool test_first_node_missing() {
     Node x(1, 0, 0);
     Node y(2, 0, 0);
@@ -106,7 +411,294 @@ bool test_common_ancestor() {
     return &root == common_ancestor(&root, &x, &y);
 }
 
-int main() {
+// Builds a tree of the given size whose shape is decided by the xorshift
+// state, numbering the nodes in postorder.
+Node* create_random_tree(int size, uint32_t& state, int& value) {
+    if (size == 0) return 0;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    int left_size = state % size;
+    Node* left = create_random_tree(left_size, state, value);
+    Node* right = create_random_tree(size - 1 - left_size, state, value);
+    return new Node(value++, left, right);
+}
+
+void delete_tree(Node* root) {
+    std::vector<Node*> stack;
+    if (root != 0) stack.push_back(root);
+    while (!stack.empty()) {
+        Node* node = stack.back();
+        stack.pop_back();
+        if (node->getLeft() != 0) stack.push_back(node->getLeft());
+        if (node->getRight() != 0) stack.push_back(node->getRight());
+        delete node;
+    }
+}
+
+bool test_flat_tree() {
+    Node x(1, 0, 0);
+    Node y(2, 0, 0);
+    Node left(3, &x, 0);
+    Node right(4, 0, &y);
+    Node root(5, &left, &right);
+    FlatTree tree(&root);
+
+    Node* preorder[] = { &root, &left, &x, &right, &y };
+    int parent[] = { -1, 0, 1, 0, 3 };
+    int depth[] = { 0, 1, 2, 1, 2 };
+    bool ret = tree.nodes.size() == 5;
+    for (int i = 0; i < 5 && ret; i++) {
+        ret = tree.nodes[i] == preorder[i] && tree.parent[i] == parent[i] &&
+              tree.depth[i] == depth[i] && tree.index(preorder[i]) == i;
+    }
+    return ret;
+}
+
+bool test_index_node_missing() {
+    Node x(1, 0, 0);
+    Node y(2, 0, 0);
+    Node root(3, 0, &y);
+    FlatTree tree(&root);
+    EulerLca euler(tree);
+    LiftingLca lifting(tree);
+
+    int thrown = 0;
+    try { euler.lca(&x, &y); } catch (const char* message) { thrown++; }
+    try { lifting.lca(&y, &x); } catch (const char* message) { thrown++; }
+    return thrown == 2;
+}
+
+bool test_index_single_node() {
+    Node root(1, 0, 0);
+    FlatTree tree(&root);
+    EulerLca euler(tree);
+    LiftingLca lifting(tree);
+
+    return euler.lca(&root, &root) == &root &&
+           lifting.lca(&root, &root) == &root;
+}
+
+bool test_index_common_ancestor() {
+    bool ret = true;
+    uint32_t state = 42;
+    for (int size = 1; size <= 64 && ret; size++) {
+        int value = 0;
+        Node* root = create_random_tree(size, state, value);
+        FlatTree tree(root);
+        EulerLca euler(tree);
+        LiftingLca lifting(tree);
+        for (int x = 0; x < size; x++) {
+            for (int y = 0; y < size; y++) {
+                int expected_x = x, expected_y = y;
+                while (expected_x != expected_y) {
+                    if (expected_x > expected_y) {
+                        expected_x = tree.parent[expected_x];
+                    } else {
+                        expected_y = tree.parent[expected_y];
+                    }
+                }
+                Node* expected = tree.nodes[expected_x];
+                ret = ret && euler.lca(x, y) == expected_x &&
+                      lifting.lca(x, y) == expected_x &&
+                      euler.lca(tree.nodes[x], tree.nodes[y]) == expected &&
+                      lifting.lca(tree.nodes[x], tree.nodes[y]) == expected;
+
+                // common_ancestor() expects neither node to be an ancestor
+                // of the other.
+                if (expected_x != x && expected_x != y) {
+                    ret = ret && common_ancestor(root, tree.nodes[x],
+                                                 tree.nodes[y]) == expected;
+                }
+            }
+        }
+        delete_tree(root);
+    }
+    return ret;
+}
+
+bool test_index_deep_tree() {
+    const int size = 100000;
+    Node* root = 0;
+    for (int i = 0; i < size; i++) {
+        root = i % 3 == 0 ? new Node(i, root, 0) : new Node(i, 0, root);
+    }
+    FlatTree tree(root);
+    EulerLca euler(tree);
+    LiftingLca lifting(tree);
+
+    // In a path every pair of nodes has the shallower one as common ancestor.
+    bool ret = true;
+    uint32_t state = 42;
+    for (int i = 0; i < 10000 && ret; i++) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        int x = state % size;
+        int y = (state >> 8) % size;
+        ret = euler.lca(x, y) == std::min(x, y) &&
+              lifting.lca(x, y) == std::min(x, y);
+    }
+    delete_tree(root);
+    return ret;
+}
+
+bool test_batch_node_missing() {
+    Node x(1, 0, 0);
+    Node y(2, 0, 0);
+    Node root(3, 0, &y);
+    std::vector< std::pair<Node*, Node*> > pairs;
+    pairs.push_back(std::make_pair(&y, &root));
+    pairs.push_back(std::make_pair(&y, &x));
+
+    try {
+        common_ancestors(&root, pairs);
+        return false;
+    } catch (const char* message) {
+        return true;
+    }
+}
+
+bool test_batch_common_ancestor() {
+    bool ret = common_ancestors(0, {}).empty();
+    uint32_t state = 42;
+    for (int size = 1; size <= 64 && ret; size++) {
+        int value = 0;
+        Node* root = create_random_tree(size, state, value);
+        FlatTree tree(root);
+        EulerLca euler(tree);
+
+        std::vector< std::pair<Node*, Node*> > pairs;
+        for (Node* x : tree.nodes) {
+            for (Node* y : tree.nodes) pairs.push_back(std::make_pair(x, y));
+        }
+        std::vector<Node*> ancestors = common_ancestors(root, pairs);
+        for (size_t i = 0; i < pairs.size() && ret; i++) {
+            ret = ancestors[i] == euler.lca(pairs[i].first, pairs[i].second);
+        }
+        delete_tree(root);
+    }
+    return ret;
+}
+
+bool test_batch_deep_tree() {
+    const int size = 1000000;
+    std::vector<Node*> nodes;
+    Node* root = 0;
+    for (int i = 0; i < size; i++) {
+        root = i % 2 == 0 ? new Node(i, root, 0) : new Node(i, 0, root);
+        nodes.push_back(root);
+    }
+
+    // The node created later is the shallower one.
+    std::vector< std::pair<Node*, Node*> > pairs;
+    uint32_t state = 42;
+    for (int i = 0; i < 10000; i++) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        pairs.push_back(std::make_pair(nodes[state % size],
+                                       nodes[(state >> 8) % size]));
+    }
+    std::vector<Node*> ancestors = common_ancestors(root, pairs);
+    bool ret = true;
+    for (size_t i = 0; i < pairs.size() && ret; i++) {
+        ret = ancestors[i] == (pairs[i].first->getValue() >
+                               pairs[i].second->getValue() ?
+                               pairs[i].first : pairs[i].second);
+    }
+    delete_tree(root);
+    return ret;
+}
+
+double elapsed_sec(std::chrono::steady_clock::time_point start) {
+    std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+template <typename F>
+double queries_per_sec(const std::vector<int>& queries, int count, F lca) {
+    long checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; i++) {
+        checksum += lca(queries[2 * i], queries[2 * i + 1]);
+    }
+    double rate = count / elapsed_sec(start);
+    if (checksum == 42) std::cout << "";
+    return rate;
+}
+
+void benchmark(int size, int count, int batch) {
+    uint32_t state = 42;
+    int value = 0;
+    Node* root = create_random_tree(size, state, value);
+    std::vector<int> queries(2 * count);
+    for (int& query : queries) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        query = state % size;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    FlatTree tree(root);
+    double flat_sec = elapsed_sec(start);
+    size_t flat_bytes = tree.nodes.size() * (sizeof(Node*) + 2 * sizeof(int)) +
+                        tree.lookup.size() * sizeof(tree.lookup[0]);
+    std::cout << "flatten," << flat_sec << "," << flat_bytes / 1000000 << ",,"
+              << std::endl;
+
+    double rate = queries_per_sec(queries, 10, [&](int x, int y) {
+        return common_ancestor(root, tree.nodes[x], tree.nodes[y])->getValue();
+    });
+    std::cout << "common_ancestor,0,0,," << rate << std::endl;
+
+    {
+        std::vector< std::pair<Node*, Node*> > pairs(batch);
+        for (int i = 0; i < batch; i++) {
+            pairs[i] = std::make_pair(tree.nodes[queries[2 * i]],
+                                      tree.nodes[queries[2 * i + 1]]);
+        }
+        start = std::chrono::steady_clock::now();
+        std::vector<Node*> ancestors = common_ancestors(root, pairs);
+        double batch_sec = elapsed_sec(start);
+        std::cout << "common_ancestors,0,0,," << batch / batch_sec
+                  << std::endl;
+    }
+
+    {
+        start = std::chrono::steady_clock::now();
+        EulerLca euler(tree);
+        double build_sec = elapsed_sec(start);
+        double index_rate = queries_per_sec(queries, count, [&](int x, int y) {
+            return euler.lca(x, y);
+        });
+        double node_rate = queries_per_sec(queries, count / 10,
+                                           [&](int x, int y) {
+            return euler.lca(tree.nodes[x], tree.nodes[y])->getValue();
+        });
+        std::cout << "euler," << build_sec << "," << euler.bytes() / 1000000
+                  << "," << index_rate << "," << node_rate << std::endl;
+    }
+    {
+        start = std::chrono::steady_clock::now();
+        LiftingLca lifting(tree);
+        double build_sec = elapsed_sec(start);
+        double index_rate = queries_per_sec(queries, count, [&](int x, int y) {
+            return lifting.lca(x, y);
+        });
+        double node_rate = queries_per_sec(queries, count / 10,
+                                           [&](int x, int y) {
+            return lifting.lca(tree.nodes[x], tree.nodes[y])->getValue();
+        });
+        std::cout << "lifting," << build_sec << "," << lifting.bytes() / 1000000
+                  << "," << index_rate << "," << node_rate << std::endl;
+    }
+    delete_tree(root);
+}
+
+int main(int argc, char* argv[]) {
     int counter = 0;
     if (!test_first_node_missing()) {
         std::cout << "First node missing test failed!" << std::endl;
@@ -124,6 +716,43 @@ int main() {
         std::cout << "Common ancestor test failed!" << std::endl;
         counter++;
     }
+    if (!test_flat_tree()) {
+        std::cout << "Flat tree test failed!" << std::endl;
+        counter++;
+    }
+    if (!test_index_node_missing()) {
+        std::cout << "Index node missing test failed!" << std::endl;
+        counter++;
+    }
+    if (!test_index_single_node()) {
+        std::cout << "Index single node test failed!" << std::endl;
+        counter++;
+    }
+    if (!test_index_common_ancestor()) {
+        std::cout << "Index common ancestor test failed!" << std::endl;
+        counter++;
+    }
+    if (!test_index_deep_tree()) {
+        std::cout << "Index deep tree test failed!" << std::endl;
+        counter++;
+    }
+    if (!test_batch_node_missing()) {
+        std::cout << "Batch node missing test failed!" << std::endl;
+        counter++;
+    }
+    if (!test_batch_common_ancestor()) {
+        std::cout << "Batch common ancestor test failed!" << std::endl;
+        counter++;
+    }
+    if (!test_batch_deep_tree()) {
+        std::cout << "Batch deep tree test failed!" << std::endl;
+        counter++;
+    }
     std::cout << counter << " tests failed." << std::endl;
+
+    int size = argc > 1 ? std::atoi(argv[1]) : 10000000;
+    std::cout << "method,build_sec,memory_mb,index_queries_sec,"
+              << "node_queries_sec" << std::endl;
+    benchmark(size, 10000000, 1000000);
 }
 
@@ -0,0 +1,672 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_X86 1
+#endif
+
+#define SUBSTRINGS 16
+#define SUBSTRING_VALUES (1 << 16)
+#define MAX_THREADS 64
+
+// Task description: The bit_diff() function in bit_diff.c counts the bits that
+// differ between two integers, i.e. their Hamming distance. Build an engine
+// that finds the k nearest neighbours of a query among a large number of
+// 256-bit binary codes, e.g. image fingerprints, by Hamming distance:
+//
+// (1) Store the codes packed in a single contiguous array.
+// (2) Scan them with a vectorized XOR and population count, splitting the
+//     store among threads that each keep their own top-k heap.
+// (3) Optionally build a multi-index hash that avoids the full scan when the
+//     neighbours are within a small radius.
+//
+// Benchmark the latency and the recall of the brute force scan against the
+// indexed mode.
+//
+// Solution: The codes are stored as an array of four 64-bit words each, so the
+// scan streams through memory sequentially. Each thread scans a contiguous
+// range of the store and keeps a max-heap of the k best (distance, id) pairs
+// seen so far, whose root is the distance a new code must beat. The heaps of
+// all threads are merged once the scan completes.
+//
+// The distance kernel processes four codes at once with AVX2. It XORs each
+// code with the query, counts the bits of every byte with two vpshufb nibble
+// lookups and sums the byte counts of each code into four 64-bit lanes with
+// vpsadbw. Since every lane is at most 64, the lanes of the four codes are
+// shifted into separate 16-bit fields of the same lanes and added, so that a
+// single horizontal sum yields all four distances. The kernel is selected at
+// runtime and falls back to the popcnt instruction, four per code.
+//
+// Multi-index hashing (Norouzi et al.) splits each code into 16 substrings of
+// 16 bits and builds one table per substring, mapping each of the 65536
+// possible values to the ids of the codes with that substring. A table is
+// simply an array of ids sorted by substring value, plus an array of 65537
+// offsets, so no hashing is needed. By the pigeonhole principle, if two codes
+// differ in at most 16 * (r + 1) - 1 bits, at least one of their substrings
+// differs in at most r bits. The k nearest neighbours are therefore found by
+// probing, for r = 0, 1, 2, ..., every table with all substring values within
+// distance r of the query's substring, verifying each candidate with its full
+// distance. Once the k-th best distance is below 16 * (r + 1), no unseen code
+// can be closer and the search stops with the exact answer. Capping r trades
+// recall for latency. Codes that appear in several tables are verified only
+// once, using a per-code stamp of the last query that saw them.
+//
+// Multi-index hashing only pays off when the neighbours are close. On codes
+// with structure, e.g. fingerprints of near duplicate images, it verifies a
+// tiny fraction of the store. On uniformly random codes the nearest neighbours
+// are about 90 bits away and the search degenerates into a slower full scan,
+// unless capped, in which case recall drops sharply.
+//
+// Results for k = 10 on a single core machine, with 10M clustered codes and
+// queries 4 bits away from a stored code, and with 1M uniform codes:
+//
+// data       mode           ms/query   recall   codes verified
+// clustered  brute             58.06    1.000         10000000
+// clustered  mih, r <= 2        0.40    1.000             2491
+// uniform    brute              5.87    1.000          1000000
+// uniform    mih, r <= 0        0.28    0.125              248
+// uniform    mih, r <= 2        3.96    0.780            32886
+// uniform    mih, exact       118.47    1.000           828765
+//
+// 100M codes take 3.2GB and their index another 6.4GB, so the default size
+// is 10M to fit in the memory of a typical machine.
+//
+// Compile with: gcc -O2 -pthread hamming_knn.c
+// Run with: ./a.out [number of codes, 10000000 by default]
+
+struct code {
+    uint64_t w[4];
+};
+
+struct neighbor {
+    int dist;
+    uint32_t id;
+};
+
+struct heap {
+    struct neighbor* items;
+    int size;
+    int k;
+};
+
+struct mih_index {
+    const struct code* codes;
+    size_t n;
+    uint32_t* offsets[SUBSTRINGS];
+    uint32_t* ids[SUBSTRINGS];
+    uint32_t* stamps;
+    uint32_t stamp;
+    uint64_t verified;
+};
+
+int bit_diff(int a, int b) {
+    int xor = a ^ b;
+    int count = 0;
+    while (xor) {
+        count += xor & 1;
+        xor = (unsigned int) xor >> 1;
+    }
+    return count;
+}
+
+static int higher(struct neighbor a, struct neighbor b) {
+    return a.dist > b.dist || (a.dist == b.dist && a.id > b.id);
+}
+
+// Offers a candidate to the max-heap of the k best neighbours.
+static void heap_offer(struct heap* h, int dist, uint32_t id) {
+    struct neighbor item = { dist, id };
+    int i;
+    if (h->size < h->k) {
+        i = h->size++;
+        while (i > 0 && higher(item, h->items[(i - 1) / 2])) {
+            h->items[i] = h->items[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+        h->items[i] = item;
+        return;
+    }
+    if (!higher(h->items[0], item)) return;
+
+    i = 0;
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= h->size) break;
+        if (child + 1 < h->size && higher(h->items[child + 1], h->items[child]))
+            child++;
+        if (!higher(h->items[child], item)) break;
+        h->items[i] = h->items[child];
+        i = child;
+    }
+    h->items[i] = item;
+}
+
+// Distance a candidate must beat to enter the heap.
+static int heap_bound(const struct heap* h) {
+    return h->size < h->k ? 257 : h->items[0].dist + 1;
+}
+
+static int compare_neighbors(const void* a, const void* b) {
+    const struct neighbor* x = a;
+    const struct neighbor* y = b;
+    return higher(*x, *y) - higher(*y, *x);
+}
+
+static int distance(const struct code* a, const struct code* b) {
+    return __builtin_popcountll(a->w[0] ^ b->w[0]) +
+           __builtin_popcountll(a->w[1] ^ b->w[1]) +
+           __builtin_popcountll(a->w[2] ^ b->w[2]) +
+           __builtin_popcountll(a->w[3] ^ b->w[3]);
+}
+
+// Offers codes [begin, end) to the heap.
+typedef void (*scan_fn)(const struct code* codes, size_t begin, size_t end,
+                        const struct code* query, struct heap* h);
+
+#ifdef HAVE_X86
+
+__attribute__((target("popcnt")))
+static void scan_popcnt(const struct code* codes, size_t begin, size_t end,
+                        const struct code* query, struct heap* h) {
+    int bound = heap_bound(h);
+    for (size_t i = begin; i < end; i++) {
+        int dist = __builtin_popcountll(codes[i].w[0] ^ query->w[0]) +
+                   __builtin_popcountll(codes[i].w[1] ^ query->w[1]) +
+                   __builtin_popcountll(codes[i].w[2] ^ query->w[2]) +
+                   __builtin_popcountll(codes[i].w[3] ^ query->w[3]);
+        if (dist < bound) {
+            heap_offer(h, dist, i);
+            bound = heap_bound(h);
+        }
+    }
+}
+
+__attribute__((target("avx2"), always_inline))
+static inline __m256i byte_counts(__m256i v) {
+    const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3,
+                                           1, 2, 2, 3, 2, 3, 3, 4,
+                                           0, 1, 1, 2, 1, 2, 2, 3,
+                                           1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low_mask = _mm256_set1_epi8(0x0f);
+    __m256i lo = _mm256_and_si256(v, low_mask);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+    return _mm256_sad_epu8(_mm256_add_epi8(_mm256_shuffle_epi8(table, lo),
+                                           _mm256_shuffle_epi8(table, hi)),
+                           _mm256_setzero_si256());
+}
+
+__attribute__((target("avx2,popcnt")))
+static void scan_avx2(const struct code* codes, size_t begin, size_t end,
+                      const struct code* query, struct heap* h) {
+    const __m256i q = _mm256_loadu_si256((const __m256i*) query);
+    int bound = heap_bound(h);
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        const __m256i* p = (const __m256i*) &codes[i];
+        __m256i c0 = byte_counts(_mm256_xor_si256(_mm256_loadu_si256(p), q));
+        __m256i c1 = byte_counts(_mm256_xor_si256(_mm256_loadu_si256(p + 1), q));
+        __m256i c2 = byte_counts(_mm256_xor_si256(_mm256_loadu_si256(p + 2), q));
+        __m256i c3 = byte_counts(_mm256_xor_si256(_mm256_loadu_si256(p + 3), q));
+        __m256i packed = _mm256_or_si256(
+            _mm256_or_si256(c0, _mm256_slli_epi64(c1, 16)),
+            _mm256_or_si256(_mm256_slli_epi64(c2, 32),
+                            _mm256_slli_epi64(c3, 48)));
+        __m128i sum = _mm_add_epi64(_mm256_castsi256_si128(packed),
+                                    _mm256_extracti128_si256(packed, 1));
+        uint64_t dists = _mm_cvtsi128_si64(sum) + _mm_extract_epi64(sum, 1);
+
+        for (int j = 0; j < 4; j++) {
+            int dist = (dists >> (16 * j)) & 0xffff;
+            if (dist < bound) {
+                heap_offer(h, dist, i + j);
+                bound = heap_bound(h);
+            }
+        }
+    }
+    for (; i < end; i++) {
+        int dist = distance(&codes[i], query);
+        if (dist < bound) {
+            heap_offer(h, dist, i);
+            bound = heap_bound(h);
+        }
+    }
+}
+
+#endif
+
+static void scan_scalar(const struct code* codes, size_t begin, size_t end,
+                        const struct code* query, struct heap* h) {
+    int bound = heap_bound(h);
+    for (size_t i = begin; i < end; i++) {
+        int dist = distance(&codes[i], query);
+        if (dist < bound) {
+            heap_offer(h, dist, i);
+            bound = heap_bound(h);
+        }
+    }
+}
+
+static scan_fn select_scan() {
+#ifdef HAVE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+        return scan_avx2;
+    }
+    if (__builtin_cpu_supports("popcnt")) return scan_popcnt;
+#endif
+    return scan_scalar;
+}
+
+static pthread_once_t scan_once = PTHREAD_ONCE_INIT;
+static scan_fn scan_best;
+
+static void init_scan() {
+    scan_best = select_scan();
+}
+
+struct scan_task {
+    const struct code* codes;
+    size_t begin;
+    size_t end;
+    const struct code* query;
+    struct heap heap;
+    scan_fn scan;
+};
+
+static void* scan_thread(void* arg) {
+    struct scan_task* task = arg;
+    task->scan(task->codes, task->begin, task->end, task->query, &task->heap);
+    return NULL;
+}
+
+// Finds the k nearest codes to query with a full scan split across threads.
+// Stores them in out sorted by distance and returns their number.
+int knn_brute(const struct code* codes, size_t n, const struct code* query,
+              int k, int threads, struct neighbor* out) {
+    pthread_once(&scan_once, init_scan);
+    scan_fn scan = scan_best;
+    if (threads < 1) threads = 1;
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+
+    struct scan_task tasks[MAX_THREADS];
+    pthread_t ids[MAX_THREADS];
+    struct neighbor* items = malloc((size_t) threads * k * sizeof *items);
+    for (int t = 0; t < threads; t++) {
+        tasks[t] = (struct scan_task) {
+            codes, n * t / threads, n * (t + 1) / threads, query,
+            { items + (size_t) t * k, 0, k }, scan
+        };
+        if (t > 0) pthread_create(&ids[t], NULL, scan_thread, &tasks[t]);
+    }
+    scan_thread(&tasks[0]);
+
+    // Merge the heaps of all threads into the first one.
+    for (int t = 1; t < threads; t++) {
+        pthread_join(ids[t], NULL);
+        for (int i = 0; i < tasks[t].heap.size; i++) {
+            struct neighbor item = tasks[t].heap.items[i];
+            heap_offer(&tasks[0].heap, item.dist, item.id);
+        }
+    }
+
+    int count = tasks[0].heap.size;
+    memcpy(out, tasks[0].heap.items, count * sizeof *out);
+    qsort(out, count, sizeof *out, compare_neighbors);
+    free(items);
+    return count;
+}
+
+static uint32_t substring(const struct code* c, int t) {
+    return (c->w[t / 4] >> (16 * (t % 4))) & 0xffff;
+}
+
+// All 16-bit masks, ordered by number of bits set, and the position of the
+// first mask with each number of bits.
+static uint16_t masks[SUBSTRING_VALUES];
+static int mask_start[18];
+
+static void init_masks() {
+    int pos = 0;
+    for (int bits = 0; bits <= 16; bits++) {
+        mask_start[bits] = pos;
+        for (int m = 0; m < SUBSTRING_VALUES; m++) {
+            if (__builtin_popcount(m) == bits) masks[pos++] = m;
+        }
+    }
+    mask_start[17] = pos;
+}
+
+void mih_build(struct mih_index* index, const struct code* codes, size_t n) {
+    if (mask_start[17] == 0) init_masks();
+    index->codes = codes;
+    index->n = n;
+    index->stamps = calloc(n, sizeof(uint32_t));
+    index->stamp = 0;
+    index->verified = 0;
+
+    // Counting sort of the ids by the value of each substring.
+    for (int t = 0; t < SUBSTRINGS; t++) {
+        uint32_t* offsets = calloc(SUBSTRING_VALUES + 1, sizeof(uint32_t));
+        uint32_t* ids = malloc(n * sizeof(uint32_t));
+        for (size_t i = 0; i < n; i++) offsets[substring(&codes[i], t) + 1]++;
+        for (int v = 0; v < SUBSTRING_VALUES; v++) {
+            offsets[v + 1] += offsets[v];
+        }
+        for (size_t i = 0; i < n; i++) {
+            ids[offsets[substring(&codes[i], t)]++] = i;
+        }
+        for (int v = SUBSTRING_VALUES; v > 0; v--) offsets[v] = offsets[v - 1];
+        offsets[0] = 0;
+
+        index->offsets[t] = offsets;
+        index->ids[t] = ids;
+    }
+}
+
+void mih_destroy(struct mih_index* index) {
+    for (int t = 0; t < SUBSTRINGS; t++) {
+        free(index->offsets[t]);
+        free(index->ids[t]);
+    }
+    free(index->stamps);
+}
+
+static void next_stamp(struct mih_index* index) {
+    if (++index->stamp == 0) {
+        memset(index->stamps, 0, index->n * sizeof(uint32_t));
+        index->stamp = 1;
+    }
+}
+
+// Verifies all codes whose substrings are at distance r from the query's.
+static void probe(struct mih_index* index, const struct code* query, int r,
+                  struct heap* h) {
+    for (int t = 0; t < SUBSTRINGS; t++) {
+        uint32_t sub = substring(query, t);
+        for (int m = mask_start[r]; m < mask_start[r + 1]; m++) {
+            uint32_t value = sub ^ masks[m];
+            const uint32_t* ids = index->ids[t];
+            for (uint32_t j = index->offsets[t][value];
+                 j < index->offsets[t][value + 1]; j++) {
+                uint32_t id = ids[j];
+                if (index->stamps[id] == index->stamp) continue;
+                index->stamps[id] = index->stamp;
+                index->verified++;
+                heap_offer(h, distance(&index->codes[id], query), id);
+            }
+        }
+    }
+}
+
+// Finds the k nearest codes to query, probing substrings up to max_radius
+// bits away. The result is exact if the search completes before max_radius
+// is exhausted. Stores the neighbours in out sorted by distance and returns
+// their number.
+int mih_knn(struct mih_index* index, const struct code* query, int k,
+            int max_radius, struct neighbor* out) {
+    struct heap h = { out, 0, k };
+    next_stamp(index);
+    for (int r = 0; r <= max_radius && r <= 16; r++) {
+        probe(index, query, r, &h);
+        if (h.size == k && h.items[0].dist < SUBSTRINGS * (r + 1)) break;
+    }
+    qsort(out, h.size, sizeof *out, compare_neighbors);
+    return h.size;
+}
+
+// Finds all codes within radius bits of the query, up to max results. Returns
+// their number.
+int mih_range(struct mih_index* index, const struct code* query, int radius,
+              struct neighbor* out, int max) {
+    int count = 0;
+    next_stamp(index);
+    for (int r = 0; r <= radius / SUBSTRINGS; r++) {
+        for (int t = 0; t < SUBSTRINGS; t++) {
+            uint32_t sub = substring(query, t);
+            for (int m = mask_start[r]; m < mask_start[r + 1]; m++) {
+                uint32_t value = sub ^ masks[m];
+                for (uint32_t j = index->offsets[t][value];
+                     j < index->offsets[t][value + 1]; j++) {
+                    uint32_t id = index->ids[t][j];
+                    if (index->stamps[id] == index->stamp) continue;
+                    index->stamps[id] = index->stamp;
+                    int dist = distance(&index->codes[id], query);
+                    if (dist <= radius && count < max) {
+                        out[count++] = (struct neighbor) { dist, id };
+                    }
+                }
+            }
+        }
+    }
+    qsort(out, count, sizeof *out, compare_neighbors);
+    return count;
+}
+
+static uint64_t next_random(uint64_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static void flip_bits(struct code* c, int bits, uint64_t* state) {
+    for (int i = 0; i < bits; i++) {
+        int bit = next_random(state) % 256;
+        c->w[bit / 64] ^= 1ULL << (bit % 64);
+    }
+}
+
+// Creates n codes. If clusters is positive, the codes are copies of that many
+// random centres with up to 8 bits flipped, otherwise uniformly random.
+struct code* create_codes(size_t n, size_t clusters, uint64_t seed) {
+    struct code* codes = malloc(n * sizeof *codes);
+    uint64_t state = seed;
+    for (size_t i = 0; i < n; i++) {
+        if (clusters > 0 && i >= clusters) {
+            codes[i] = codes[next_random(&state) % clusters];
+            flip_bits(&codes[i], 1 + next_random(&state) % 8, &state);
+        } else {
+            for (int w = 0; w < 4; w++) codes[i].w[w] = next_random(&state);
+        }
+    }
+    return codes;
+}
+
+// Distances from the query to each of the given neighbours must be right.
+static int check_distances(const struct code* codes, const struct code* query,
+                           const struct neighbor* out, int count) {
+    for (int i = 0; i < count; i++) {
+        if (out[i].dist != distance(&codes[out[i].id], query)) return 0;
+    }
+    return 1;
+}
+
+int test_distance() {
+    struct code a = { { 0, 0, 0, 0 } };
+    struct code b = { { 0x0f, 0, 1ULL << 63, ~0ULL } };
+
+    // Distance agrees with bit_diff() on every 32-bit half.
+    int expected = 0;
+    for (int w = 0; w < 4; w++) {
+        expected += bit_diff(a.w[w], b.w[w]) + bit_diff(a.w[w] >> 32,
+                                                        b.w[w] >> 32);
+    }
+    return 69 == distance(&a, &b) && 69 == expected &&
+           0 == distance(&b, &b);
+}
+
+int test_brute_force() {
+    struct code* codes = create_codes(10003, 0, 1);
+    struct code query = codes[77];
+    flip_bits(&query, 3, &(uint64_t) { 5 });
+
+    int ret = 1;
+    struct neighbor expected[10], actual[10];
+    int count = knn_brute(codes, 10003, &query, 10, 1, expected);
+    ret = ret && 10 == count && 77 == expected[0].id &&
+          expected[0].dist <= 3 &&
+          check_distances(codes, &query, expected, count);
+
+    // A naive sort of all codes agrees with the result, as do several threads.
+    struct neighbor* all = malloc(10003 * sizeof *all);
+    for (size_t i = 0; i < 10003; i++) {
+        all[i] = (struct neighbor) { distance(&codes[i], &query), i };
+    }
+    qsort(all, 10003, sizeof *all, compare_neighbors);
+    ret = ret && 0 == memcmp(expected, all, sizeof expected);
+    free(all);
+
+    for (int threads = 2; threads <= 7; threads++) {
+        count = knn_brute(codes, 10003, &query, 10, threads, actual);
+        ret = ret && 10 == count &&
+              0 == memcmp(expected, actual, sizeof expected);
+    }
+
+    count = knn_brute(codes, 5, &query, 10, 3, actual);
+    free(codes);
+    return ret && 5 == count;
+}
+
+int test_mih_knn() {
+    struct code* codes = create_codes(50000, 500, 2);
+    struct mih_index index;
+    mih_build(&index, codes, 50000);
+
+    int ret = 1;
+    uint64_t state = 9;
+    for (int q = 0; q < 50; q++) {
+        struct code query = codes[next_random(&state) % 50000];
+        flip_bits(&query, q % 20, &state);
+
+        struct neighbor expected[20], actual[20];
+        int count = knn_brute(codes, 50000, &query, 20, 1, expected);
+        ret = ret && count == mih_knn(&index, &query, 20, 16, actual) &&
+              0 == memcmp(expected, actual, count * sizeof *actual);
+    }
+
+    mih_destroy(&index);
+    free(codes);
+    return ret;
+}
+
+int test_mih_range() {
+    struct code* codes = create_codes(30000, 300, 3);
+    struct mih_index index;
+    mih_build(&index, codes, 30000);
+
+    int ret = 1;
+    struct neighbor out[30000];
+    for (int radius = 0; radius <= 40; radius += 8) {
+        struct code query = codes[radius * 13];
+        int count = mih_range(&index, &query, radius, out, 30000);
+
+        int expected = 0;
+        for (size_t i = 0; i < 30000; i++) {
+            expected += distance(&codes[i], &query) <= radius;
+        }
+        ret = ret && count == expected && out[0].dist == 0 &&
+              check_distances(codes, &query, out, count);
+    }
+
+    mih_destroy(&index);
+    free(codes);
+    return ret;
+}
+
+double elapsed_ms(struct timespec* start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1e3 +
+           (end.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+// Fraction of the results whose distance is within the true k-th distance.
+static double recall(const struct neighbor* expected,
+                     const struct neighbor* actual, int expected_count,
+                     int actual_count) {
+    int found = 0;
+    for (int i = 0; i < actual_count; i++) {
+        found += actual[i].dist <= expected[expected_count - 1].dist;
+    }
+    return (double) found / expected_count;
+}
+
+void run_benchmark(const char* name, size_t n, size_t clusters) {
+    const int k = 10, queries = 20;
+    struct code* codes = create_codes(n, clusters, 42);
+    struct code* query = malloc(queries * sizeof *query);
+    uint64_t state = 7;
+    for (int q = 0; q < queries; q++) {
+        query[q] = codes[next_random(&state) % n];
+        flip_bits(&query[q], 4, &state);
+    }
+
+    struct neighbor (*truth)[10] = malloc(queries * sizeof *truth);
+    struct neighbor out[10];
+    struct timespec start;
+    for (int threads = 1; threads <= 4; threads *= 2) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int q = 0; q < queries; q++) {
+            knn_brute(codes, n, &query[q], k, threads, truth[q]);
+        }
+        printf("%s,%zu,brute,%d,%.3f,1.000,%zu\n", name, n, threads,
+               elapsed_ms(&start) / queries, n);
+    }
+
+    struct mih_index index;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    mih_build(&index, codes, n);
+    printf("%s,%zu,mih_build,1,%.3f,,\n", name, n, elapsed_ms(&start));
+
+    int radii[] = { 0, 1, 2, 16 };
+    for (int i = 0; i < 4; i++) {
+        int max_radius = radii[i];
+        double total = 0;
+        index.verified = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int q = 0; q < queries; q++) {
+            int count = mih_knn(&index, &query[q], k, max_radius, out);
+            total += recall(truth[q], out, k, count);
+        }
+        printf("%s,%zu,mih_r%d,1,%.3f,%.3f,%llu\n", name, n, max_radius,
+               elapsed_ms(&start) / queries, total / queries,
+               (unsigned long long) index.verified / queries);
+        fflush(stdout);
+    }
+
+    mih_destroy(&index);
+    free(truth);
+    free(query);
+    free(codes);
+}
+
+int main(int argc, char** argv) {
+    int counter = 0;
+    if (!test_distance()) {
+        printf("Distance test failed!\n");
+        counter++;
+    }
+    if (!test_brute_force()) {
+        printf("Brute force test failed!\n");
+        counter++;
+    }
+    if (!test_mih_knn()) {
+        printf("Multi-index hashing knn test failed!\n");
+        counter++;
+    }
+    if (!test_mih_range()) {
+        printf("Multi-index hashing range test failed!\n");
+        counter++;
+    }
+    printf("%d tests failed.\n", counter);
+
+    size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 10000000;
+    printf("data,codes,mode,threads,ms_per_query,recall,verified_per_query\n");
+    run_benchmark("clustered", n, n / 100);
+    run_benchmark("uniform", n / 10, 0);
+}
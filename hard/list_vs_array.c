@@ -1,7 +1,17 @@
+#define _GNU_SOURCE
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 // Task description: A system is generating a stream of positive integers and
 // we would like to store these integers in memory in ascending order. Write
 // code to store the incoming integers in two data structures: (a) Singly
@@ -10,6 +20,12 @@
 // Which data structure do you expect to perform better? Compare the performance
 // for different input sizes and explain the actual results.
 //
+// Then extend the comparison with more cache conscious structures: a linked
+// list whose nodes come from a pre-allocated pool, an unrolled linked list, the
+// leaf chain of a B+-tree, a skip list and a gap buffer. Sweep the input size
+// up to 10M and report the results as CSV, including the last level cache
+// misses where performance counters are available.
+//
 // Solution: Storing the incoming integers in a sorted, singly linked list
 // requires O(n/2) to find the right spot to insert each integer and O(1) to
 // actually perform the insertion. Thus the overal complexity is O(n) (linear)
@@ -31,147 +47,691 @@
 // misses that tax its performance significantly.
 //
 // Please note that we would get similar results even if we factor out the
-// extra memory allocations that the linked list solution involves.
+// extra memory allocations that the linked list solution involves. The pool
+// list demonstrates this: its nodes are allocated back to back from a single
+// array, but as the values arrive in random order, traversing the list still
+// jumps randomly across the pool.
+//
+// The remaining structures all try to combine the locality of the array with
+// cheaper insertions:
 //
-// Results:
+// (1) Unrolled linked list: Each node holds a small sorted array of values that
+//     spans a couple of cache lines. Finding the right node is still a linear
+//     walk, but there are B times fewer nodes to visit, where B is the number
+//     of values per node. Inserting only shifts values within one node and a
+//     full node is split in two.
+// (2) B+-tree leaf chain: The leaves are the nodes of an unrolled linked list,
+//     with a tree of separator keys on top that locates the right leaf in
+//     O(log n). Insertions are O(log n) and the sorted output is obtained by
+//     walking the leaf chain.
+// (3) Skip list: A linked list with extra express lanes, where each node is
+//     promoted to the next level with probability 1/4. Insertions are expected
+//     O(log n), but every step is a pointer dereference into a random location
+//     and therefore a likely cache miss.
+// (4) Gap buffer: An array with a gap of free slots that is moved to the
+//     insertion point with memmove(). Binary search finds the position in
+//     O(log n), but moving the gap is O(n) for random input. It shines when
+//     consecutive insertions are close to each other, e.g. nearly sorted input.
 //
-// Running test with size: 1
-// Adding to list took: 1
-// Adding to array took: 1
+// Structures with O(n) insertion cost are only run up to the size where the
+// quadratic total becomes impractical. Results on a single core machine, in
+// nanoseconds per insertion with random input (LLC misses were not available):
 //
-// Running test with size: 10
-// Adding to list took: 1
-// Adding to array took: 2
+// structure   size=1K  size=10K  size=100K  size=1M  size=10M
+// list           1440    48500          -        -         -
+// pool_list       680    20200          -        -         -
+// array           200     1960      21400        -         -
+// unrolled        120      760      24500        -         -
+// gap_buffer      120      300       3700        -         -
+// bplus_tree      125      165        290      545       690
+// skip_list       135      185        360     1690      4370
 //
-// Running test with size: 100
-// Adding to list took: 15
-// Adding to array took: 10
+// The list loses to the array at every size and the pool only halves its cost.
+// The unrolled list beats the array while its nodes fit in the cache, but the
+// walk over thousands of nodes is again dominated by cache misses at 100K. The
+// gap buffer beats the array thanks to binary search and memmove(). Only the
+// logarithmic structures scale to millions of elements and the B+-tree, which
+// keeps the values contiguous in its leaves, is several times faster than the
+// pointer chasing skip list.
 //
-// Running test with size: 1000
-// Adding to list took: 661
-// Adding to array took: 380
+// By default the sizes stop at 1M, which takes about 7 seconds. The 10M column
+// above comes from ./a.out 10000000, where the skip list alone takes about 47
+// seconds.
 //
-// Running test with size: 10000
-// Adding to list took: 220785
-// Adding to array took: 34925
+// Compile with: gcc -O2 list_vs_array.c
+// Run with: ./a.out [maximum size, 1000000 by default]
+
+struct structure {
+    const char* name;
+    size_t max_size;
+    void* (*create)(size_t capacity);
+    void (*add)(void* s, int value);
+    size_t (*to_array)(void* s, int* out);
+    void (*destroy)(void* s);
+};
 
 struct node {
     int value;
     struct node *next;
 };
 
-struct node *head = NULL;
-int *array = NULL;
-int array_size = 0;
-
-void add_list(int value) {
-    struct node *new_node = malloc(sizeof *new_node);
-    new_node->value = value;
-
-    if (head == NULL) {
-        head = new_node;
-        return;
-    }
-
-    struct node* curr = head;
+static void insert_node(struct node** head, struct node* new_node) {
+    struct node* curr = *head;
     struct node* prev = NULL;
-    while (curr && curr->value < value) {
+    while (curr && curr->value < new_node->value) {
         prev = curr;
         curr = curr->next;
     }
+    new_node->next = curr;
     if (!prev) {
-        head = new_node;
-        new_node->next = curr;
+        *head = new_node;
     } else {
         prev->next = new_node;
-        new_node->next = curr;
     }
 }
 
-void free_list() {
-    struct node* curr = head;
+static size_t list_to_array(struct node* curr, int* out) {
+    size_t count = 0;
+    for (; curr; curr = curr->next) out[count++] = curr->value;
+    return count;
+}
+
+// Linked list with every node allocated by malloc().
+
+struct list {
+    struct node* head;
+};
+
+void* list_create(size_t capacity) {
+    (void) capacity;
+    return calloc(1, sizeof(struct list));
+}
+
+void add_list(void* s, int value) {
+    struct node *new_node = malloc(sizeof *new_node);
+    new_node->value = value;
+    insert_node(&((struct list*) s)->head, new_node);
+}
+
+size_t list_values(void* s, int* out) {
+    return list_to_array(((struct list*) s)->head, out);
+}
+
+void free_list(void* s) {
+    struct node* curr = ((struct list*) s)->head;
     struct node* next;
-    head = NULL;
 
     while (curr) {
         next = curr->next;
         free(curr);
         curr = next;
     }
+    free(s);
+}
+
+// Linked list with all nodes allocated consecutively from a single array.
+
+struct pool_list {
+    struct node* head;
+    struct node* pool;
+    size_t used;
+};
+
+void* pool_list_create(size_t capacity) {
+    struct pool_list* list = calloc(1, sizeof *list);
+    list->pool = malloc(capacity * sizeof(struct node));
+    return list;
+}
+
+void add_pool_list(void* s, int value) {
+    struct pool_list* list = s;
+    struct node* new_node = &list->pool[list->used++];
+    new_node->value = value;
+    insert_node(&list->head, new_node);
+}
+
+size_t pool_list_values(void* s, int* out) {
+    return list_to_array(((struct pool_list*) s)->head, out);
+}
+
+void free_pool_list(void* s) {
+    free(((struct pool_list*) s)->pool);
+    free(s);
+}
+
+// Pre-allocated array, shifting all values after the insertion point.
+
+struct array {
+    int* data;
+    size_t size;
+};
+
+void* array_create(size_t capacity) {
+    struct array* array = calloc(1, sizeof *array);
+    array->data = malloc(capacity * sizeof(int));
+    return array;
+}
+
+void add_array(void* s, int value) {
+    struct array* array = s;
+    size_t pos;
+    for (pos = 0; pos < array->size; pos++) {
+        if (array->data[pos] > value) break;
+    }
+
+    for (size_t i = array->size; i > pos; i--) {
+        array->data[i] = array->data[i-1];
+    }
+    array->data[pos] = value;
+    array->size++;
+}
+
+size_t array_values(void* s, int* out) {
+    struct array* array = s;
+    memcpy(out, array->data, array->size * sizeof(int));
+    return array->size;
+}
+
+void free_array(void* s) {
+    free(((struct array*) s)->data);
+    free(s);
+}
+
+// Unrolled linked list: 29 values per node, so that a node is 128 bytes.
+
+#define UNROLLED_CAPACITY 29
+
+struct unrolled_node {
+    struct unrolled_node* next;
+    int count;
+    int values[UNROLLED_CAPACITY];
+};
+
+void* unrolled_create(size_t capacity) {
+    (void) capacity;
+    return calloc(1, sizeof(struct unrolled_node));
+}
+
+void add_unrolled(void* s, int value) {
+    struct unrolled_node* node = s;
+    while (node->next && node->next->values[0] <= value) node = node->next;
+
+    if (node->count == UNROLLED_CAPACITY) {
+        struct unrolled_node* right = malloc(sizeof *right);
+        int half = UNROLLED_CAPACITY / 2;
+        right->count = UNROLLED_CAPACITY - half;
+        memcpy(right->values, node->values + half, right->count * sizeof(int));
+        right->next = node->next;
+        node->next = right;
+        node->count = half;
+        if (value >= right->values[0]) node = right;
+    }
+
+    int pos = node->count;
+    while (pos > 0 && node->values[pos - 1] > value) {
+        node->values[pos] = node->values[pos - 1];
+        pos--;
+    }
+    node->values[pos] = value;
+    node->count++;
+}
+
+size_t unrolled_values(void* s, int* out) {
+    size_t count = 0;
+    for (struct unrolled_node* node = s; node; node = node->next) {
+        memcpy(out + count, node->values, node->count * sizeof(int));
+        count += node->count;
+    }
+    return count;
+}
+
+void free_unrolled(void* s) {
+    struct unrolled_node* node = s;
+    while (node) {
+        struct unrolled_node* next = node->next;
+        free(node);
+        node = next;
+    }
+}
+
+// B+-tree with 256 byte leaves chained together in sorted order.
+
+#define LEAF_CAPACITY 61
+#define INNER_CAPACITY 31
+
+struct leaf {
+    struct leaf* next;
+    int count;
+    int values[LEAF_CAPACITY];
+};
+
+struct inner {
+    int count;
+    int keys[INNER_CAPACITY];
+    void* children[INNER_CAPACITY + 1];
+};
+
+struct bplus_tree {
+    void* root;
+    int height;
+};
+
+// Returns the number of values in array that are less than or equal to value.
+static int upper_bound(const int* array, int count, int value) {
+    int lo = 0, hi = count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (array[mid] <= value) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+void* bplus_create(size_t capacity) {
+    (void) capacity;
+    struct bplus_tree* tree = malloc(sizeof *tree);
+    tree->root = calloc(1, sizeof(struct leaf));
+    tree->height = 0;
+    return tree;
+}
+
+// Inserts value in the subtree rooted at node. If the node had to be split,
+// returns the new right sibling and stores its smallest key in split_key.
+static void* bplus_insert(void* node, int height, int value, int* split_key) {
+    if (height == 0) {
+        struct leaf* leaf = node;
+        int pos = upper_bound(leaf->values, leaf->count, value);
+        memmove(leaf->values + pos + 1, leaf->values + pos,
+                (leaf->count - pos) * sizeof(int));
+        leaf->values[pos] = value;
+        if (++leaf->count < LEAF_CAPACITY) return NULL;
+
+        struct leaf* right = malloc(sizeof *right);
+        int half = LEAF_CAPACITY / 2;
+        right->count = LEAF_CAPACITY - half;
+        memcpy(right->values, leaf->values + half, right->count * sizeof(int));
+        right->next = leaf->next;
+        leaf->next = right;
+        leaf->count = half;
+        *split_key = right->values[0];
+        return right;
+    }
+
+    struct inner* inner = node;
+    int pos = upper_bound(inner->keys, inner->count, value);
+    int key;
+    void* child = bplus_insert(inner->children[pos], height - 1, value, &key);
+    if (child == NULL) return NULL;
+
+    memmove(inner->keys + pos + 1, inner->keys + pos,
+            (inner->count - pos) * sizeof(int));
+    memmove(inner->children + pos + 2, inner->children + pos + 1,
+            (inner->count - pos) * sizeof(void*));
+    inner->keys[pos] = key;
+    inner->children[pos + 1] = child;
+    if (++inner->count < INNER_CAPACITY) return NULL;
+
+    // The middle key moves up to the parent.
+    struct inner* right = malloc(sizeof *right);
+    int half = INNER_CAPACITY / 2;
+    right->count = INNER_CAPACITY - half - 1;
+    memcpy(right->keys, inner->keys + half + 1, right->count * sizeof(int));
+    memcpy(right->children, inner->children + half + 1,
+           (right->count + 1) * sizeof(void*));
+    inner->count = half;
+    *split_key = inner->keys[half];
+    return right;
+}
+
+void add_bplus(void* s, int value) {
+    struct bplus_tree* tree = s;
+    int key;
+    void* right = bplus_insert(tree->root, tree->height, value, &key);
+    if (right == NULL) return;
+
+    struct inner* root = malloc(sizeof *root);
+    root->count = 1;
+    root->keys[0] = key;
+    root->children[0] = tree->root;
+    root->children[1] = right;
+    tree->root = root;
+    tree->height++;
+}
+
+static struct leaf* bplus_first_leaf(struct bplus_tree* tree) {
+    void* node = tree->root;
+    for (int h = tree->height; h > 0; h--) {
+        node = ((struct inner*) node)->children[0];
+    }
+    return node;
+}
+
+size_t bplus_values(void* s, int* out) {
+    size_t count = 0;
+    for (struct leaf* leaf = bplus_first_leaf(s); leaf; leaf = leaf->next) {
+        memcpy(out + count, leaf->values, leaf->count * sizeof(int));
+        count += leaf->count;
+    }
+    return count;
+}
+
+static void bplus_free(void* node, int height) {
+    if (height > 0) {
+        struct inner* inner = node;
+        for (int i = 0; i <= inner->count; i++) {
+            bplus_free(inner->children[i], height - 1);
+        }
+    }
+    free(node);
 }
 
-void add_array(int value) {
-    int pos;
-    for (pos = 0; pos < array_size; pos++) {
-        if (array[pos] > value) break;
+void free_bplus(void* s) {
+    struct bplus_tree* tree = s;
+    bplus_free(tree->root, tree->height);
+    free(tree);
+}
+
+// Skip list where each node is promoted to the next level with probability
+// 1/4, which gives on average 1.33 pointers per node.
+
+#define SKIP_LEVELS 16
+
+struct skip_node {
+    int value;
+    struct skip_node* next[];
+};
+
+struct skip_list {
+    uint64_t random;
+    struct skip_node* head;
+};
+
+void* skip_create(size_t capacity) {
+    (void) capacity;
+    struct skip_list* list = malloc(sizeof(struct skip_list));
+    list->head = calloc(1, sizeof(struct skip_node) +
+                           SKIP_LEVELS * sizeof(void*));
+    list->random = 88172645463325252ULL;
+    return list;
+}
+
+void add_skip(void* s, int value) {
+    struct skip_list* list = s;
+    list->random ^= list->random << 13;
+    list->random ^= list->random >> 7;
+    list->random ^= list->random << 17;
+
+    int levels = 1;
+    uint64_t bits = list->random;
+    while (levels < SKIP_LEVELS && (bits & 3) == 0) {
+        levels++;
+        bits >>= 2;
     }
 
-    for (int i = array_size; i >= pos; i--) {
-        array[i] = array[i-1];
+    struct skip_node* node = malloc(sizeof *node + levels * sizeof(void*));
+    node->value = value;
+
+    struct skip_node* curr = list->head;
+    for (int level = SKIP_LEVELS - 1; level >= 0; level--) {
+        while (curr->next[level] && curr->next[level]->value <= value) {
+            curr = curr->next[level];
+        }
+        if (level < levels) {
+            node->next[level] = curr->next[level];
+            curr->next[level] = node;
+        }
     }
-    array[pos] = value;
 }
 
-int assert_correctness() {
-    for (int i = 0; i < array_size - 1; i++) {
-        if (array[i] > array[i + 1]) return 0;
+size_t skip_values(void* s, int* out) {
+    size_t count = 0;
+    struct skip_node* curr = ((struct skip_list*) s)->head->next[0];
+    for (; curr; curr = curr->next[0]) out[count++] = curr->value;
+    return count;
+}
+
+void free_skip(void* s) {
+    struct skip_list* list = s;
+    struct skip_node* curr = list->head;
+    while (curr) {
+        struct skip_node* next = curr->next[0];
+        free(curr);
+        curr = next;
     }
+    free(list);
+}
+
+// Gap buffer: values are stored in data[0, gap_start) and data[gap_end,
+// capacity), with the free slots in between.
 
-    struct node* current = head;
-    int i = 0;
-    while(current) {
-        if (current->next && current->next->value < current->value)
-            return 0;
-        if (current->value != array[i++])
-            return 0;
-        current = current->next;
+struct gap_buffer {
+    int* data;
+    size_t gap_start;
+    size_t gap_end;
+    size_t capacity;
+};
+
+void* gap_create(size_t capacity) {
+    struct gap_buffer* buffer = malloc(sizeof *buffer);
+    buffer->data = malloc(capacity * sizeof(int));
+    buffer->gap_start = 0;
+    buffer->gap_end = capacity;
+    buffer->capacity = capacity;
+    return buffer;
+}
+
+void add_gap(void* s, int value) {
+    struct gap_buffer* b = s;
+    int* after = b->data + b->gap_end;
+    size_t after_count = b->capacity - b->gap_end;
+
+    // The value belongs either before the gap, moving its tail after the gap,
+    // or after the gap, moving the front of the second part before the gap.
+    if (b->gap_start > 0 && b->data[b->gap_start - 1] > value) {
+        size_t pos = upper_bound(b->data, b->gap_start, value);
+        size_t move = b->gap_start - pos;
+        memmove(b->data + b->gap_end - move, b->data + pos, move * sizeof(int));
+        b->gap_start = pos;
+        b->gap_end -= move;
+    } else if (after_count > 0 && after[0] <= value) {
+        size_t move = upper_bound(after, after_count, value);
+        memmove(b->data + b->gap_start, after, move * sizeof(int));
+        b->gap_start += move;
+        b->gap_end += move;
     }
-    return 1;
+    b->data[b->gap_start++] = value;
+}
+
+size_t gap_values(void* s, int* out) {
+    struct gap_buffer* b = s;
+    size_t after = b->capacity - b->gap_end;
+    memcpy(out, b->data, b->gap_start * sizeof(int));
+    memcpy(out + b->gap_start, b->data + b->gap_end, after * sizeof(int));
+    return b->gap_start + after;
+}
+
+void free_gap(void* s) {
+    free(((struct gap_buffer*) s)->data);
+    free(s);
+}
+
+// Structures with O(n) insertions are capped, as their total cost is O(n^2).
+struct structure structures[] = {
+    { "list", 10000, list_create, add_list, list_values, free_list },
+    { "pool_list", 10000, pool_list_create, add_pool_list, pool_list_values,
+      free_pool_list },
+    { "array", 100000, array_create, add_array, array_values, free_array },
+    { "unrolled", 100000, unrolled_create, add_unrolled, unrolled_values,
+      free_unrolled },
+    { "gap_buffer", 100000, gap_create, add_gap, gap_values, free_gap },
+    { "bplus_tree", SIZE_MAX, bplus_create, add_bplus, bplus_values,
+      free_bplus },
+    { "skip_list", SIZE_MAX, skip_create, add_skip, skip_values, free_skip },
+};
+
+#define STRUCTURES (sizeof(structures) / sizeof(structures[0]))
+
+// Counts last level cache misses of this thread, if the kernel allows it.
+static int perf_open() {
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof attr);
+    attr.size = sizeof attr;
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    return -1;
+#endif
+}
+
+static void perf_start(int fd) {
+#ifdef __linux__
+    if (fd < 0) return;
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+}
+
+static long long perf_stop(int fd) {
+    long long count = -1;
+#ifdef __linux__
+    if (fd < 0) return -1;
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(fd, &count, sizeof count) != sizeof count) return -1;
+#endif
+    return count;
+}
+
+static int compare(const void* a, const void* b) {
+    int x = *(const int*) a, y = *(const int*) b;
+    return (x > y) - (x < y);
 }
 
-int * create_random(int size) {
+int * create_random(size_t size, uint64_t seed) {
     int *result = malloc(size * sizeof *result);
-    srand(clock());
-    for (int i = 0; i < size; i++) {
-        result[i] = rand();
+    for (size_t i = 0; i < size; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        result[i] = seed >> 33;
     }
     return result;
 }
 
-void run_test(unsigned int size) {
-    printf("Running test with size: %u\n", size);
+// Inserts all values and checks that the structure returns them sorted.
+int assert_correctness(struct structure* s, const int* values, size_t size) {
+    int* expected = malloc((size + 1) * sizeof(int));
+    int* actual = malloc((size + 1) * sizeof(int));
+    memcpy(expected, values, size * sizeof(int));
+    qsort(expected, size, sizeof(int), compare);
 
-    array = malloc(size * sizeof *array);
-    array_size = 0;
-    int *random = create_random(size);
+    void* instance = s->create(size);
+    for (size_t i = 0; i < size; i++) s->add(instance, values[i]);
+    size_t count = s->to_array(instance, actual);
+    s->destroy(instance);
 
-    clock_t start = clock();
-    for (int i = 0; i < size; i++) {
-        add_list(random[i]);
+    int ret = count == size &&
+              0 == memcmp(expected, actual, size * sizeof(int));
+    free(expected);
+    free(actual);
+    return ret;
+}
+
+int test_random() {
+    int ret = 1;
+    int* values = create_random(5000, 1);
+    for (size_t i = 0; i < STRUCTURES; i++) {
+        ret = ret && assert_correctness(&structures[i], values, 5000);
     }
-    printf("Adding to list took: %ld\n", (clock() - start));
+    free(values);
+    return ret;
+}
 
-    start = clock();
-    for (int i = 0; i < size; i++) {
-        add_array(random[i]);
-        ++array_size;
+int test_sorted_and_reversed() {
+    int ascending[3000], descending[3000];
+    for (int i = 0; i < 3000; i++) {
+        ascending[i] = i;
+        descending[i] = 3000 - i;
     }
-    printf("Adding to array took: %ld\n\n", (clock() - start));
 
-    if (!assert_correctness(head)) {
-        printf("Values are not ordered in list or array!");
+    int ret = 1;
+    for (size_t i = 0; i < STRUCTURES; i++) {
+        ret = ret && assert_correctness(&structures[i], ascending, 3000) &&
+              assert_correctness(&structures[i], descending, 3000);
     }
+    return ret;
+}
 
-    free(array);
-    free(random);
-    free_list();
+int test_duplicates() {
+    int values[4000];
+    for (int i = 0; i < 4000; i++) values[i] = (i * 7919) % 13;
+
+    int ret = 1;
+    for (size_t i = 0; i < STRUCTURES; i++) {
+        ret = ret && assert_correctness(&structures[i], values, 4000) &&
+              assert_correctness(&structures[i], values, 1) &&
+              assert_correctness(&structures[i], values, 0);
+    }
+    return ret;
 }
 
-int main() {
-    run_test(1);
-    run_test(10);
-    run_test(100);
-    run_test(1000);
-    run_test(10000);
+void run_test(struct structure* s, size_t size, int perf_fd) {
+    int *random = create_random(size, size);
+    void* instance = s->create(size);
+
+    struct timespec start, end;
+    perf_start(perf_fd);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < size; i++) {
+        s->add(instance, random[i]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    long long misses = perf_stop(perf_fd);
+
+    double ns = (end.tv_sec - start.tv_sec) * 1e9 +
+                (end.tv_nsec - start.tv_nsec);
+    printf("%s,%zu,%.0f,%.1f,", s->name, size, ns, ns / size);
+    if (misses >= 0) printf("%lld", misses);
+    printf("\n");
+    fflush(stdout);
+
+    s->destroy(instance);
+    free(random);
 }
 
+int main(int argc, char** argv) {
+    int counter = 0;
+    if (!test_random()) {
+        printf("Random test failed!\n");
+        counter++;
+    }
+    if (!test_sorted_and_reversed()) {
+        printf("Sorted and reversed test failed!\n");
+        counter++;
+    }
+    if (!test_duplicates()) {
+        printf("Duplicates test failed!\n");
+        counter++;
+    }
+    printf("%d tests failed.\n", counter);
+
+    size_t max_size = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+    int perf_fd = perf_open();
+
+    printf("structure,size,total_ns,ns_per_insert,llc_misses\n");
+    for (size_t i = 0; i < STRUCTURES; i++) {
+        for (size_t size = 10; size <= max_size; size *= 10) {
+            if (size > structures[i].max_size) break;
+            run_test(&structures[i], size, perf_fd);
+        }
+    }
+
+#ifdef __linux__
+    if (perf_fd >= 0) close(perf_fd);
+#endif
+}
@@ -0,0 +1,1071 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define WORD_BITS 64
+#define CHUNK_BITS 65536
+#define ARRAY_MAX 4096
+#define BITMAP_BYTES (CHUNK_BITS / 8)
+#define MAGIC 0x314d4252
+
+// Task description: The dense BitSet in easy/bit_set.cpp allocates one bit for
+// every possible position, even when only a handful of bits are set. Sparse id
+// sets therefore waste a lot of memory. Implement a compressed bitmap that
+// stays small for sparse, clustered and dense sets alike, supports fast
+// intersection and union, and can be serialized to a flat format that can be
+// memory mapped and queried without deserializing it. Compare memory and
+// operation throughput against the dense BitSet.
+//
+// Solution: The implementation below follows the design of Roaring bitmaps.
+// The 32 bit universe is split into chunks of 2^16 values, keyed by the high 16
+// bits of each value. Only non empty chunks are stored, in a sorted array of
+// keys with a matching array of containers. Each container holds the low 16
+// bits of the values in its chunk, using one of three representations:
+//
+// (1) ARRAY: A sorted array of 16 bit values, used for sparse chunks with up to
+//     4096 values. At that point it takes 8KB, the same as a bitmap.
+// (2) BITMAP: A dense BitSet of 65536 bits (8KB), used for chunks with more than
+//     4096 values.
+// (3) RUN: A sorted array of runs (start, length - 1), used when the values in
+//     the chunk form long consecutive stretches. Run containers are created by
+//     run_optimize(), which picks the smallest of the three representations
+//     for every chunk, like the original Roaring implementation.
+//
+// Intersection and union walk the two key arrays in step and only combine
+// containers with matching keys, using a dedicated algorithm for each pair of
+// container kinds: array / array is a sorted merge (switching to binary search
+// when one side is much smaller), array / bitmap probes the bitmap for every
+// array value, bitmap / bitmap combines whole words, and run / run merges the
+// interval lists. The remaining pairs with runs either filter the array
+// against the runs or expand the runs into a bitmap. After each operation the
+// result is converted to an array if small enough, or to a bitmap if an array
+// would grow beyond 4096 values.
+//
+// The serialized format consists of an 8 byte header (magic, container count),
+// followed by a 16 byte descriptor per container (key, type, cardinality,
+// offset and element count) and finally the container payloads, each aligned to
+// 8 bytes. A RoaringView can be placed directly over such a buffer, e.g. one
+// returned by mmap(), and answers contains() by binary searching the
+// descriptors and then the payload in place. Values are stored in native byte
+// order. Both deserialize() and RoaringView take the size of the buffer and
+// check every descriptor against it and against the container limits before
+// use, throwing invalid_argument for truncated or corrupt input.
+
+using namespace std;
+
+// Same word based BitSet as in easy/bit_set.cpp, reduced to the operations the
+// containers need and extended with set_range().
+class BitSet {
+
+    private:
+        unsigned size;
+        unsigned words;
+        uint64_t *bits;
+
+    public:
+        BitSet(unsigned size);
+        BitSet(const BitSet& other);
+        ~BitSet();
+        bool get(unsigned pos) const;
+        void set(unsigned pos);
+        void set_range(unsigned start, unsigned end);
+        unsigned count() const;
+        unsigned find_next(unsigned pos) const;
+        const uint64_t* data() const { return bits; }
+        uint64_t* data() { return bits; }
+        BitSet& operator&=(const BitSet& other);
+        BitSet& operator|=(const BitSet& other);
+};
+
+BitSet::BitSet(unsigned size) : size(size) {
+    words = (size + WORD_BITS - 1) / WORD_BITS;
+    bits = new uint64_t[words] { 0 };
+}
+
+BitSet::BitSet(const BitSet& other) : size(other.size), words(other.words) {
+    bits = new uint64_t[words];
+    memcpy(bits, other.bits, words * sizeof(uint64_t));
+}
+
+BitSet::~BitSet() {
+    delete[] bits;
+}
+
+bool BitSet::get(unsigned pos) const {
+    if (pos >= size) {
+        throw out_of_range("Position is out of range");
+    }
+    return (bits[pos / WORD_BITS] >> (pos % WORD_BITS)) & 1;
+}
+
+void BitSet::set(unsigned pos) {
+    if (pos >= size) {
+        throw out_of_range("Position is out of range");
+    }
+    bits[pos / WORD_BITS] |= (uint64_t) 1 << (pos % WORD_BITS);
+}
+
+// Sets all bits in positions [start, end].
+void BitSet::set_range(unsigned start, unsigned end) {
+    if (end >= size || start > end) {
+        throw out_of_range("Range is out of range");
+    }
+
+    unsigned first = start / WORD_BITS, last = end / WORD_BITS;
+    uint64_t first_mask = ~(uint64_t) 0 << (start % WORD_BITS);
+    uint64_t last_mask = ~(uint64_t) 0 >> (WORD_BITS - 1 - end % WORD_BITS);
+    if (first == last) {
+        bits[first] |= first_mask & last_mask;
+        return;
+    }
+
+    bits[first] |= first_mask;
+    for (unsigned i = first + 1; i < last; i++) bits[i] = ~(uint64_t) 0;
+    bits[last] |= last_mask;
+}
+
+unsigned BitSet::count() const {
+    unsigned total = 0;
+    for (unsigned i = 0; i < words; i++) {
+        total += __builtin_popcountll(bits[i]);
+    }
+    return total;
+}
+
+unsigned BitSet::find_next(unsigned pos) const {
+    if (pos >= size) return size;
+
+    unsigned word = pos / WORD_BITS;
+    uint64_t value = bits[word] & (~(uint64_t) 0 << (pos % WORD_BITS));
+    while (value == 0) {
+        if (++word >= words) return size;
+        value = bits[word];
+    }
+    return word * WORD_BITS + __builtin_ctzll(value);
+}
+
+BitSet& BitSet::operator&=(const BitSet& other) {
+    for (unsigned i = 0; i < words; i++) bits[i] &= other.bits[i];
+    return *this;
+}
+
+BitSet& BitSet::operator|=(const BitSet& other) {
+    for (unsigned i = 0; i < words; i++) bits[i] |= other.bits[i];
+    return *this;
+}
+
+// A run of consecutive values [start, start + length].
+struct Run {
+    uint16_t start;
+    uint16_t length;
+
+    unsigned end() const { return start + length; }
+};
+
+class Container {
+
+    public:
+        enum Type { ARRAY, BITMAP, RUN };
+
+        Type type;
+        unsigned cardinality;
+        vector<uint16_t> array;
+        vector<Run> runs;
+        BitSet* bitmap;
+
+        Container() : type(ARRAY), cardinality(0), bitmap(NULL) { }
+        Container(const Container& other);
+        Container(Container&& other);
+        Container& operator=(Container other);
+        ~Container() { delete bitmap; }
+
+        bool contains(uint16_t value) const;
+        void add(uint16_t value);
+        void add_to_runs(uint16_t value);
+        void to_array();
+        void to_bitmap();
+        void to_runs();
+        void optimize();
+        size_t size_in_bytes() const;
+
+        static Container intersect(const Container& a, const Container& b);
+        static Container unite(const Container& a, const Container& b);
+
+        template <class F> void for_each(F f) const;
+};
+
+Container::Container(const Container& other) :
+        type(other.type), cardinality(other.cardinality),
+        array(other.array), runs(other.runs), bitmap(NULL) {
+    if (other.bitmap != NULL) bitmap = new BitSet(*other.bitmap);
+}
+
+Container::Container(Container&& other) :
+        type(other.type), cardinality(other.cardinality),
+        array(move(other.array)), runs(move(other.runs)),
+        bitmap(other.bitmap) {
+    other.bitmap = NULL;
+}
+
+Container& Container::operator=(Container other) {
+    swap(type, other.type);
+    swap(cardinality, other.cardinality);
+    swap(array, other.array);
+    swap(runs, other.runs);
+    swap(bitmap, other.bitmap);
+    return *this;
+}
+
+// Calls f for every value in the container, in ascending order.
+template <class F> void Container::for_each(F f) const {
+    if (type == ARRAY) {
+        for (uint16_t value : array) f(value);
+    } else if (type == BITMAP) {
+        for (unsigned pos = bitmap->find_next(0); pos < CHUNK_BITS;
+             pos = bitmap->find_next(pos + 1)) {
+            f(pos);
+        }
+    } else {
+        for (const Run& run : runs) {
+            for (unsigned value = run.start; value <= run.end(); value++) {
+                f(value);
+            }
+        }
+    }
+}
+
+static bool runs_contain(const Run* runs, unsigned n, uint16_t value) {
+    unsigned lo = 0, hi = n;
+    while (lo < hi) {
+        unsigned mid = (lo + hi) / 2;
+        if (runs[mid].start <= value) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo > 0 && runs[lo - 1].end() >= value;
+}
+
+bool Container::contains(uint16_t value) const {
+    if (type == ARRAY) return binary_search(array.begin(), array.end(), value);
+    if (type == BITMAP) return bitmap->get(value);
+    return runs_contain(runs.data(), runs.size(), value);
+}
+
+void Container::add(uint16_t value) {
+    if (contains(value)) return;
+
+    if (type == RUN) {
+        add_to_runs(value);
+        return;
+    }
+
+    if (type == ARRAY) {
+        if (cardinality < ARRAY_MAX) {
+            array.insert(lower_bound(array.begin(), array.end(), value), value);
+            cardinality++;
+            return;
+        }
+        to_bitmap();
+    }
+
+    bitmap->set(value);
+    cardinality++;
+}
+
+// Extends the neighbouring runs if the value is adjacent to them, otherwise
+// inserts a new run of length one.
+void Container::add_to_runs(uint16_t value) {
+    auto next = upper_bound(runs.begin(), runs.end(), value,
+            [](uint16_t v, const Run& run) { return v < run.start; });
+    bool joins_prev = next != runs.begin() && (next - 1)->end() + 1 == value;
+    bool joins_next = next != runs.end() && value + 1 == next->start;
+
+    if (joins_prev && joins_next) {
+        (next - 1)->length += next->length + 2;
+        runs.erase(next);
+    } else if (joins_prev) {
+        (next - 1)->length++;
+    } else if (joins_next) {
+        next->start--;
+        next->length++;
+    } else {
+        Run run = { value, 0 };
+        runs.insert(next, run);
+    }
+    cardinality++;
+}
+
+void Container::to_array() {
+    vector<uint16_t> values;
+    values.reserve(cardinality);
+    for_each([&values](unsigned value) { values.push_back(value); });
+
+    array.swap(values);
+    runs.clear();
+    delete bitmap;
+    bitmap = NULL;
+    type = ARRAY;
+}
+
+void Container::to_bitmap() {
+    BitSet* bits = new BitSet(CHUNK_BITS);
+    if (type == RUN) {
+        for (const Run& run : runs) bits->set_range(run.start, run.end());
+    } else {
+        for_each([bits](unsigned value) { bits->set(value); });
+    }
+
+    delete bitmap;
+    bitmap = bits;
+    array.clear();
+    runs.clear();
+    type = BITMAP;
+}
+
+void Container::to_runs() {
+    vector<Run> result;
+    for_each([&result](unsigned value) {
+        if (!result.empty() && result.back().end() + 1 == value) {
+            result.back().length++;
+        } else {
+            Run run = { (uint16_t) value, 0 };
+            result.push_back(run);
+        }
+    });
+
+    runs.swap(result);
+    array.clear();
+    delete bitmap;
+    bitmap = NULL;
+    type = RUN;
+}
+
+// Switches to the representation with the smallest serialized size.
+void Container::optimize() {
+    unsigned run_count = 0;
+    int last = -2;
+    for_each([&run_count, &last](unsigned value) {
+        if ((int) value != last + 1) run_count++;
+        last = value;
+    });
+
+    size_t run_bytes = run_count * sizeof(Run);
+    size_t array_bytes = cardinality * sizeof(uint16_t);
+    if (run_bytes < array_bytes && run_bytes < BITMAP_BYTES) {
+        if (type != RUN) to_runs();
+    } else if (cardinality <= ARRAY_MAX) {
+        if (type != ARRAY) to_array();
+    } else if (type != BITMAP) {
+        to_bitmap();
+    }
+}
+
+size_t Container::size_in_bytes() const {
+    if (type == ARRAY) return array.size() * sizeof(uint16_t);
+    if (type == BITMAP) return BITMAP_BYTES;
+    return runs.size() * sizeof(Run);
+}
+
+static void merge_runs(vector<Run>& runs, unsigned start, unsigned end) {
+    if (!runs.empty() && runs.back().end() + 1 >= start) {
+        if (end > runs.back().end()) {
+            runs.back().length = end - runs.back().start;
+        }
+    } else {
+        Run run = { (uint16_t) start, (uint16_t) (end - start) };
+        runs.push_back(run);
+    }
+}
+
+static vector<Run> as_runs(const Container& c) {
+    if (c.type == Container::RUN) return c.runs;
+    vector<Run> result;
+    c.for_each([&result](unsigned value) { merge_runs(result, value, value); });
+    return result;
+}
+
+static Container from_runs(vector<Run>& runs) {
+    Container result;
+    result.type = Container::RUN;
+    result.runs.swap(runs);
+    for (const Run& run : result.runs) result.cardinality += run.length + 1;
+    result.optimize();
+    return result;
+}
+
+Container Container::intersect(const Container& a, const Container& b) {
+    Container result;
+
+    if (a.type == ARRAY && b.type == ARRAY) {
+        const vector<uint16_t>& small = a.cardinality < b.cardinality ? a.array
+                                                                       : b.array;
+        const vector<uint16_t>& large = a.cardinality < b.cardinality ? b.array
+                                                                       : a.array;
+        if (small.size() * 32 < large.size()) {
+            auto it = large.begin();
+            for (uint16_t value : small) {
+                it = lower_bound(it, large.end(), value);
+                if (it == large.end()) break;
+                if (*it == value) result.array.push_back(value);
+            }
+        } else {
+            set_intersection(small.begin(), small.end(),
+                             large.begin(), large.end(),
+                             back_inserter(result.array));
+        }
+    } else if (a.type == ARRAY || b.type == ARRAY) {
+        const Container& arr = a.type == ARRAY ? a : b;
+        const Container& other = a.type == ARRAY ? b : a;
+        for (uint16_t value : arr.array) {
+            if (other.contains(value)) result.array.push_back(value);
+        }
+    } else if (a.type == RUN && b.type == RUN) {
+        vector<Run> runs;
+        unsigned i = 0, j = 0;
+        while (i < a.runs.size() && j < b.runs.size()) {
+            unsigned start = max(a.runs[i].start, b.runs[j].start);
+            unsigned end = min(a.runs[i].end(), b.runs[j].end());
+            if (start <= end) merge_runs(runs, start, end);
+            if (a.runs[i].end() < b.runs[j].end()) i++;
+            else j++;
+        }
+        return from_runs(runs);
+    } else {
+        Container x(a), y(b);
+        if (x.type != BITMAP) x.to_bitmap();
+        if (y.type != BITMAP) y.to_bitmap();
+        *x.bitmap &= *y.bitmap;
+        x.cardinality = x.bitmap->count();
+        if (x.cardinality <= ARRAY_MAX) x.to_array();
+        return x;
+    }
+
+    result.cardinality = result.array.size();
+    return result;
+}
+
+Container Container::unite(const Container& a, const Container& b) {
+    if (a.type == ARRAY && b.type == ARRAY) {
+        Container result;
+        set_union(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+                  back_inserter(result.array));
+        result.cardinality = result.array.size();
+        if (result.cardinality > ARRAY_MAX) result.to_bitmap();
+        return result;
+    }
+
+    if (a.type == BITMAP || b.type == BITMAP) {
+        Container result(a.type == BITMAP ? a : b);
+        const Container& other = a.type == BITMAP ? b : a;
+        if (other.type == BITMAP) {
+            *result.bitmap |= *other.bitmap;
+        } else if (other.type == RUN) {
+            for (const Run& run : other.runs) {
+                result.bitmap->set_range(run.start, run.end());
+            }
+        } else {
+            for (uint16_t value : other.array) result.bitmap->set(value);
+        }
+        result.cardinality = result.bitmap->count();
+        return result;
+    }
+
+    // At least one side is a run container: merge both as interval lists.
+    vector<Run> x = as_runs(a), y = as_runs(b), runs;
+    unsigned i = 0, j = 0;
+    while (i < x.size() || j < y.size()) {
+        const Run& next = j == y.size() || (i < x.size() && x[i].start < y[j].start)
+                          ? x[i++] : y[j++];
+        merge_runs(runs, next.start, next.end());
+    }
+    return from_runs(runs);
+}
+
+class RoaringBitmap {
+
+    private:
+        vector<uint16_t> keys;
+        vector<Container> containers;
+
+        friend class RoaringView;
+
+    public:
+        void add(uint32_t value);
+        bool contains(uint32_t value) const;
+        uint64_t cardinality() const;
+        size_t size_in_bytes() const;
+        void run_optimize();
+        vector<uint32_t> to_vector() const;
+
+        RoaringBitmap operator&(const RoaringBitmap& other) const;
+        RoaringBitmap operator|(const RoaringBitmap& other) const;
+
+        vector<char> serialize() const;
+        static RoaringBitmap deserialize(const char* data, size_t size);
+};
+
+void RoaringBitmap::add(uint32_t value) {
+    uint16_t key = value >> 16;
+    auto it = lower_bound(keys.begin(), keys.end(), key);
+    size_t pos = it - keys.begin();
+    if (it == keys.end() || *it != key) {
+        keys.insert(it, key);
+        containers.insert(containers.begin() + pos, Container());
+    }
+    containers[pos].add(value & 0xFFFF);
+}
+
+bool RoaringBitmap::contains(uint32_t value) const {
+    uint16_t key = value >> 16;
+    auto it = lower_bound(keys.begin(), keys.end(), key);
+    if (it == keys.end() || *it != key) return false;
+    return containers[it - keys.begin()].contains(value & 0xFFFF);
+}
+
+uint64_t RoaringBitmap::cardinality() const {
+    uint64_t total = 0;
+    for (const Container& c : containers) total += c.cardinality;
+    return total;
+}
+
+size_t RoaringBitmap::size_in_bytes() const {
+    size_t total = keys.size() * sizeof(uint16_t);
+    for (const Container& c : containers) {
+        total += sizeof(Container) + c.size_in_bytes();
+    }
+    return total;
+}
+
+void RoaringBitmap::run_optimize() {
+    for (Container& c : containers) c.optimize();
+}
+
+vector<uint32_t> RoaringBitmap::to_vector() const {
+    vector<uint32_t> result;
+    for (size_t i = 0; i < keys.size(); i++) {
+        uint32_t high = (uint32_t) keys[i] << 16;
+        containers[i].for_each([&result, high](unsigned value) {
+            result.push_back(high | value);
+        });
+    }
+    return result;
+}
+
+RoaringBitmap RoaringBitmap::operator&(const RoaringBitmap& other) const {
+    RoaringBitmap result;
+    size_t i = 0, j = 0;
+    while (i < keys.size() && j < other.keys.size()) {
+        if (keys[i] < other.keys[j]) {
+            i++;
+        } else if (keys[i] > other.keys[j]) {
+            j++;
+        } else {
+            Container c = Container::intersect(containers[i],
+                                               other.containers[j]);
+            if (c.cardinality > 0) {
+                result.keys.push_back(keys[i]);
+                result.containers.push_back(c);
+            }
+            i++;
+            j++;
+        }
+    }
+    return result;
+}
+
+RoaringBitmap RoaringBitmap::operator|(const RoaringBitmap& other) const {
+    RoaringBitmap result;
+    size_t i = 0, j = 0;
+    while (i < keys.size() || j < other.keys.size()) {
+        if (j == other.keys.size() ||
+            (i < keys.size() && keys[i] < other.keys[j])) {
+            result.keys.push_back(keys[i]);
+            result.containers.push_back(containers[i++]);
+        } else if (i == keys.size() || keys[i] > other.keys[j]) {
+            result.keys.push_back(other.keys[j]);
+            result.containers.push_back(other.containers[j++]);
+        } else {
+            result.keys.push_back(keys[i]);
+            result.containers.push_back(
+                    Container::unite(containers[i++], other.containers[j++]));
+        }
+    }
+    return result;
+}
+
+struct Header {
+    uint32_t magic;
+    uint32_t count;
+};
+
+struct Descriptor {
+    uint16_t key;
+    uint16_t type;
+    uint32_t cardinality;
+    uint32_t offset;
+    uint32_t elements;
+};
+
+static size_t align8(size_t bytes) {
+    return (bytes + 7) & ~(size_t) 7;
+}
+
+vector<char> RoaringBitmap::serialize() const {
+    size_t offset = sizeof(Header) + keys.size() * sizeof(Descriptor);
+    vector<Descriptor> descriptors;
+    for (size_t i = 0; i < keys.size(); i++) {
+        const Container& c = containers[i];
+        Descriptor d = { keys[i], (uint16_t) c.type, c.cardinality,
+                         (uint32_t) offset, 0 };
+        d.elements = c.type == Container::ARRAY ? c.array.size()
+                   : c.type == Container::RUN ? c.runs.size()
+                   : CHUNK_BITS / WORD_BITS;
+        descriptors.push_back(d);
+        offset += align8(c.size_in_bytes());
+    }
+
+    vector<char> buffer(offset, 0);
+    Header header = { MAGIC, (uint32_t) keys.size() };
+    memcpy(buffer.data(), &header, sizeof(header));
+    memcpy(buffer.data() + sizeof(header), descriptors.data(),
+           descriptors.size() * sizeof(Descriptor));
+
+    for (size_t i = 0; i < keys.size(); i++) {
+        const Container& c = containers[i];
+        char* dest = buffer.data() + descriptors[i].offset;
+        if (c.type == Container::ARRAY) {
+            memcpy(dest, c.array.data(), c.size_in_bytes());
+        } else if (c.type == Container::RUN) {
+            memcpy(dest, c.runs.data(), c.size_in_bytes());
+        } else {
+            memcpy(dest, c.bitmap->data(), BITMAP_BYTES);
+        }
+    }
+    return buffer;
+}
+
+// Checks that every descriptor of a serialized bitmap of the given size is
+// within the container limits and points to a payload inside the buffer, so
+// that neither deserialize() nor RoaringView read outside of it. Throws
+// invalid_argument otherwise.
+static const Header* check_serialized(const char* data, size_t size) {
+    if (size < sizeof(Header)) {
+        throw invalid_argument("Serialized bitmap is truncated");
+    }
+    const Header* header = (const Header*) data;
+    if (header->magic != MAGIC) {
+        throw invalid_argument("Not a serialized roaring bitmap");
+    }
+    if (header->count > CHUNK_BITS) {
+        throw invalid_argument("Serialized bitmap is corrupt");
+    }
+    if ((size - sizeof(Header)) / sizeof(Descriptor) < header->count) {
+        throw invalid_argument("Serialized bitmap is truncated");
+    }
+
+    const Descriptor* descriptors = (const Descriptor*) (data + sizeof(Header));
+    size_t payloads = sizeof(Header) + header->count * sizeof(Descriptor);
+    for (uint32_t i = 0; i < header->count; i++) {
+        const Descriptor& d = descriptors[i];
+        size_t element_size, max_elements;
+        if (d.type == Container::ARRAY) {
+            element_size = sizeof(uint16_t);
+            max_elements = ARRAY_MAX;
+        } else if (d.type == Container::RUN) {
+            element_size = sizeof(Run);
+            max_elements = CHUNK_BITS / 2;
+        } else if (d.type == Container::BITMAP) {
+            element_size = sizeof(uint64_t);
+            max_elements = CHUNK_BITS / WORD_BITS;
+        } else {
+            throw invalid_argument("Serialized bitmap is corrupt");
+        }
+
+        if ((i > 0 && d.key <= descriptors[i - 1].key) ||
+            d.elements > max_elements || d.cardinality > CHUNK_BITS ||
+            (d.type == Container::BITMAP && d.elements != max_elements) ||
+            d.offset % 8 != 0 || d.offset < payloads) {
+            throw invalid_argument("Serialized bitmap is corrupt");
+        }
+        if (d.offset > size || (size - d.offset) / element_size < d.elements) {
+            throw invalid_argument("Serialized bitmap is truncated");
+        }
+    }
+    return header;
+}
+
+RoaringBitmap RoaringBitmap::deserialize(const char* data, size_t size) {
+    const Header* header = check_serialized(data, size);
+    const Descriptor* descriptors = (const Descriptor*) (data + sizeof(Header));
+    RoaringBitmap result;
+    for (uint32_t i = 0; i < header->count; i++) {
+        const Descriptor& d = descriptors[i];
+        const char* payload = data + d.offset;
+        Container c;
+        c.type = (Container::Type) d.type;
+        if (c.type == Container::ARRAY) {
+            const uint16_t* values = (const uint16_t*) payload;
+            c.array.assign(values, values + d.elements);
+            c.cardinality = c.array.size();
+        } else if (c.type == Container::RUN) {
+            const Run* runs = (const Run*) payload;
+            c.runs.assign(runs, runs + d.elements);
+            for (const Run& run : c.runs) {
+                if (run.end() >= CHUNK_BITS) {
+                    throw invalid_argument("Serialized bitmap is corrupt");
+                }
+                c.cardinality += run.length + 1;
+            }
+        } else {
+            c.bitmap = new BitSet(CHUNK_BITS);
+            memcpy(c.bitmap->data(), payload, BITMAP_BYTES);
+            c.cardinality = c.bitmap->count();
+        }
+        if (c.cardinality != d.cardinality) {
+            throw invalid_argument("Serialized bitmap is corrupt");
+        }
+        result.keys.push_back(d.key);
+        result.containers.push_back(move(c));
+    }
+    return result;
+}
+
+// Read only view over a serialized bitmap, e.g. a memory mapped file.
+class RoaringView {
+
+    private:
+        const char* data;
+        const Descriptor* descriptors;
+        uint32_t count;
+
+    public:
+        RoaringView(const char* data, size_t size) : data(data) {
+            count = check_serialized(data, size)->count;
+            descriptors = (const Descriptor*) (data + sizeof(Header));
+        }
+
+        bool contains(uint32_t value) const {
+            uint16_t key = value >> 16, low = value & 0xFFFF;
+            unsigned lo = 0, hi = count;
+            while (lo < hi) {
+                unsigned mid = (lo + hi) / 2;
+                if (descriptors[mid].key < key) lo = mid + 1;
+                else hi = mid;
+            }
+            if (lo == count || descriptors[lo].key != key) return false;
+
+            const Descriptor& d = descriptors[lo];
+            const char* payload = data + d.offset;
+            if (d.type == Container::ARRAY) {
+                const uint16_t* values = (const uint16_t*) payload;
+                return binary_search(values, values + d.elements, low);
+            }
+            if (d.type == Container::RUN) {
+                return runs_contain((const Run*) payload, d.elements, low);
+            }
+            const uint64_t* words = (const uint64_t*) payload;
+            return (words[low / WORD_BITS] >> (low % WORD_BITS)) & 1;
+        }
+
+        uint64_t cardinality() const {
+            uint64_t total = 0;
+            for (uint32_t i = 0; i < count; i++) {
+                total += descriptors[i].cardinality;
+            }
+            return total;
+        }
+};
+
+bool test_add_contains() {
+    RoaringBitmap bitmap;
+    bitmap.add(5);
+    bitmap.add(70000);
+    bitmap.add(5);
+    bitmap.add(4000000000u);
+
+    return bitmap.contains(5) && bitmap.contains(70000) &&
+           bitmap.contains(4000000000u) && !bitmap.contains(6) &&
+           !bitmap.contains(70001) && 3 == bitmap.cardinality();
+}
+
+bool test_array_to_bitmap() {
+    RoaringBitmap bitmap;
+    for (uint32_t i = 0; i < 10000; i++) bitmap.add(i * 3);
+
+    for (uint32_t i = 0; i < 30000; i++) {
+        if (bitmap.contains(i) != (i % 3 == 0)) return false;
+    }
+    return 10000 == bitmap.cardinality() && bitmap.size_in_bytes() > 8192;
+}
+
+bool test_run_optimize() {
+    RoaringBitmap bitmap;
+    for (uint32_t i = 100; i < 60000; i++) bitmap.add(i);
+    for (uint32_t i = 200000; i < 200010; i++) bitmap.add(i);
+
+    vector<uint32_t> before = bitmap.to_vector();
+    bitmap.run_optimize();
+    bitmap.add(99);
+    bitmap.add(60000);
+    before.insert(before.begin(), 99);
+    before.insert(before.begin() + 59901, 60000);
+
+    return before == bitmap.to_vector() && bitmap.size_in_bytes() < 200;
+}
+
+// Builds a bitmap of every container kind and compares intersection and
+// union with std::set_intersection and std::set_union on plain vectors.
+bool test_intersect_unite() {
+    vector<uint32_t> a, b;
+    for (uint32_t i = 0; i < 400000; i += 7) a.push_back(i);
+    for (uint32_t i = 0; i < 400000; i += 50) b.push_back(i);
+    for (uint32_t i = 500000; i < 600000; i++) a.push_back(i);
+    for (uint32_t i = 550000; i < 700000; i += 2) b.push_back(i);
+    for (uint32_t i = 800000; i < 820000; i++) b.push_back(i);
+    for (uint32_t i = 810000; i < 830000; i++) a.push_back(i);
+    sort(a.begin(), a.end());
+    a.erase(unique(a.begin(), a.end()), a.end());
+    sort(b.begin(), b.end());
+
+    RoaringBitmap x, y;
+    for (uint32_t v : a) x.add(v);
+    for (uint32_t v : b) y.add(v);
+
+    vector<uint32_t> and_expected, or_expected;
+    set_intersection(a.begin(), a.end(), b.begin(), b.end(),
+                     back_inserter(and_expected));
+    set_union(a.begin(), a.end(), b.begin(), b.end(),
+              back_inserter(or_expected));
+
+    for (int round = 0; round < 2; round++) {
+        if ((x & y).to_vector() != and_expected ||
+            (y & x).to_vector() != and_expected ||
+            (x | y).to_vector() != or_expected ||
+            (y | x).to_vector() != or_expected) {
+            return false;
+        }
+        x.run_optimize();
+        y.run_optimize();
+    }
+    return true;
+}
+
+bool test_serialize() {
+    RoaringBitmap bitmap;
+    for (uint32_t i = 0; i < 100000; i += 3) bitmap.add(i);
+    for (uint32_t i = 300000; i < 400000; i++) bitmap.add(i);
+    bitmap.add(3000000000u);
+    bitmap.run_optimize();
+
+    vector<char> buffer = bitmap.serialize();
+    RoaringBitmap copy = RoaringBitmap::deserialize(buffer.data(),
+                                                    buffer.size());
+    RoaringView view(buffer.data(), buffer.size());
+
+    for (uint32_t i = 0; i < 500000; i++) {
+        if (view.contains(i) != bitmap.contains(i)) return false;
+    }
+    return copy.to_vector() == bitmap.to_vector() &&
+           view.contains(3000000000u) &&
+           view.cardinality() == bitmap.cardinality();
+}
+
+// Returns true if both deserialize() and RoaringView reject the buffer.
+bool rejected(const vector<char>& buffer, size_t size) {
+    try {
+        RoaringBitmap::deserialize(buffer.data(), size);
+        return false;
+    } catch (const invalid_argument&) { }
+    try {
+        RoaringView view(buffer.data(), size);
+        return false;
+    } catch (const invalid_argument&) { }
+    return true;
+}
+
+bool test_serialize_corrupt() {
+    RoaringBitmap bitmap;
+    bitmap.add(1);
+    for (uint32_t i = 70000; i < 80000; i++) bitmap.add(i);
+    vector<char> buffer = bitmap.serialize();
+    Descriptor* descriptors = (Descriptor*) (buffer.data() + sizeof(Header));
+    if (descriptors[1].type != Container::BITMAP) return false;
+
+    bool ret = true;
+    for (size_t size : { (size_t) 0, (size_t) 7, (size_t) 20, buffer.size() - 1 }) {
+        ret = ret && rejected(buffer, size);
+    }
+
+    vector<char> copy = buffer;
+    descriptors = (Descriptor*) (copy.data() + sizeof(Header));
+    descriptors[1].elements = CHUNK_BITS / WORD_BITS + 1;
+    ret = ret && rejected(copy, copy.size());
+
+    copy = buffer;
+    descriptors = (Descriptor*) (copy.data() + sizeof(Header));
+    descriptors[0].offset = copy.size() - 8;
+    descriptors[0].elements = 5;
+    ret = ret && rejected(copy, copy.size());
+
+    copy = buffer;
+    descriptors = (Descriptor*) (copy.data() + sizeof(Header));
+    descriptors[0].type = 3;
+    ret = ret && rejected(copy, copy.size());
+
+    copy = buffer;
+    ((Header*) copy.data())->count = 1000;
+    ret = ret && rejected(copy, copy.size());
+
+    copy = buffer;
+    descriptors = (Descriptor*) (copy.data() + sizeof(Header));
+    descriptors[1].cardinality = 9999;
+    try {
+        RoaringBitmap::deserialize(copy.data(), copy.size());
+        ret = false;
+    } catch (const invalid_argument&) { }
+    return ret;
+}
+
+bool test_mmap_view() {
+    RoaringBitmap bitmap;
+    for (uint32_t i = 0; i < 1000000; i += 11) bitmap.add(i);
+    vector<char> buffer = bitmap.serialize();
+
+    FILE* file = tmpfile();
+    if (file == NULL) return false;
+    fwrite(buffer.data(), 1, buffer.size(), file);
+    fflush(file);
+
+    void* mapped = mmap(NULL, buffer.size(), PROT_READ, MAP_PRIVATE,
+                        fileno(file), 0);
+    if (mapped == MAP_FAILED) {
+        fclose(file);
+        return false;
+    }
+
+    RoaringView view((const char*) mapped, buffer.size());
+    bool ret = view.cardinality() == bitmap.cardinality();
+    for (uint32_t i = 0; i < 1000000 && ret; i++) {
+        ret = view.contains(i) == (i % 11 == 0);
+    }
+
+    munmap(mapped, buffer.size());
+    fclose(file);
+    return ret;
+}
+
+double seconds_since(chrono::steady_clock::time_point start) {
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+// Compares a dense BitSet with a roaring bitmap over a universe of size bits,
+// holding every step-th value, or consecutive runs of run_length values.
+void run_benchmark(const char* name, uint32_t universe, unsigned step,
+                   unsigned run_length) {
+    vector<uint32_t> values;
+    for (uint64_t v = 0; v < universe; v += step) {
+        for (unsigned r = 0; r < run_length && v + r < universe; r++) {
+            values.push_back(v + r);
+        }
+    }
+    vector<uint32_t> others;
+    for (uint32_t v : values) others.push_back((v + step / 2) % universe);
+    sort(others.begin(), others.end());
+
+    auto start = chrono::steady_clock::now();
+    BitSet dense_a(universe), dense_b(universe);
+    for (uint32_t v : values) dense_a.set(v);
+    for (uint32_t v : others) dense_b.set(v);
+    double dense_build = seconds_since(start);
+
+    start = chrono::steady_clock::now();
+    RoaringBitmap roaring_a, roaring_b;
+    for (uint32_t v : values) roaring_a.add(v);
+    for (uint32_t v : others) roaring_b.add(v);
+    roaring_a.run_optimize();
+    roaring_b.run_optimize();
+    double roaring_build = seconds_since(start);
+
+    start = chrono::steady_clock::now();
+    BitSet dense_and(dense_a);
+    dense_and &= dense_b;
+    BitSet dense_or(dense_a);
+    dense_or |= dense_b;
+    double dense_ops = seconds_since(start);
+
+    start = chrono::steady_clock::now();
+    RoaringBitmap roaring_and = roaring_a & roaring_b;
+    RoaringBitmap roaring_or = roaring_a | roaring_b;
+    double roaring_ops = seconds_since(start);
+
+    unsigned hits = 0;
+    start = chrono::steady_clock::now();
+    for (uint32_t i = 0; i < 1000000; i++) {
+        hits += dense_a.get((i * 2654435761u) % universe);
+    }
+    double dense_lookup = seconds_since(start);
+
+    start = chrono::steady_clock::now();
+    for (uint32_t i = 0; i < 1000000; i++) {
+        hits -= roaring_a.contains((i * 2654435761u) % universe);
+    }
+    double roaring_lookup = seconds_since(start);
+
+    if (hits != 0 || dense_and.count() != roaring_and.cardinality() ||
+        dense_or.count() != roaring_or.cardinality()) {
+        cout << "Benchmark results do not match!" << endl;
+    }
+
+    printf("%s,%zu,%zu,%zu,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f\n", name,
+           values.size(), (size_t) universe / 8, roaring_a.size_in_bytes(),
+           dense_build, roaring_build, dense_ops, roaring_ops,
+           dense_lookup, roaring_lookup);
+}
+
+int main() {
+    int counter = 0;
+    if (!test_add_contains()) {
+        cout << "Add contains test failed!" << endl;
+        counter++;
+    }
+    if (!test_array_to_bitmap()) {
+        cout << "Array to bitmap test failed!" << endl;
+        counter++;
+    }
+    if (!test_run_optimize()) {
+        cout << "Run optimize test failed!" << endl;
+        counter++;
+    }
+    if (!test_intersect_unite()) {
+        cout << "Intersect unite test failed!" << endl;
+        counter++;
+    }
+    if (!test_serialize()) {
+        cout << "Serialize test failed!" << endl;
+        counter++;
+    }
+    if (!test_serialize_corrupt()) {
+        cout << "Serialize corrupt test failed!" << endl;
+        counter++;
+    }
+    if (!test_mmap_view()) {
+        cout << "Mmap view test failed!" << endl;
+        counter++;
+    }
+    cout << counter << " tests failed." << endl;
+
+    cout << "set,values,dense_bytes,roaring_bytes,dense_build_s,"
+         << "roaring_build_s,dense_and_or_s,roaring_and_or_s,"
+         << "dense_1M_lookups_s,roaring_1M_lookups_s" << endl;
+    run_benchmark("sparse", 100000000, 10000, 1);
+    run_benchmark("medium", 100000000, 100, 1);
+    run_benchmark("dense", 100000000, 2, 1);
+    run_benchmark("runs", 100000000, 10000, 1000);
+}
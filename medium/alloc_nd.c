@@ -0,0 +1,428 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_DIMS 8
+#define CACHE_LINE 64
+#define ALIAS_STRIDE 512
+
+#define ALLOC_PAD 1
+
+// Task description: The alloc2d_opt() function in alloc2d.c allocates a two
+// dimensional int array with a single call to malloc(), placing a header of row
+// pointers in front of the data so that it can be accessed as array[i][j].
+// Generalize it into an allocator for N dimensional arrays of any element type
+// that:
+//
+// (1) Keeps the array[i][j]...[k] access notation and the single allocation.
+// (2) Aligns every row (the innermost dimension) to a cache line.
+// (3) Optionally pads the row stride to avoid 4K aliasing.
+// (4) Supports views and slices of the array without copying any data.
+//
+// Benchmark row and column traversal, as well as matrix transpose, with and
+// without padding.
+//
+// Solution: A single block of memory is allocated holding, in order, a small
+// descriptor, the tables of pointers and the data. For an array of shape
+// (s0, s1, ..., sn) the first table holds s0 pointers to the second level
+// tables, the second level holds s0 * s1 pointers and so on, with the last
+// level pointing directly to the rows of data. This is exactly the layout of
+// alloc2d_opt() for two dimensions, extended with one extra level of pointers
+// per dimension. allocnd() returns a pointer to the first table, so that the
+// caller can cast it to e.g. double*** and use the usual notation.
+//
+// The data is aligned to a cache line and the row stride is rounded up to a
+// multiple of the cache line, so that every row starts on a new cache line.
+// This costs some padding at the end of each row but ensures that vectorized
+// loops over a row never split loads across cache lines.
+//
+// 4K aliasing happens when the row stride is a multiple of 4096 bytes, e.g. a
+// 1024 x 1024 matrix of floats. Walking down a column then touches addresses
+// that map to the same L1 cache set, and only as many of them as the cache
+// associativity (typically 8) can be cached at once. Loads can also be falsely
+// detected as depending on earlier stores to an address 4096 bytes apart.
+// Strides of 2048, 1024 or 512 bytes are hardly better, as a column then only
+// uses 2, 4 or 8 of the 64 sets of a typical 32KB L1 cache. With ALLOC_PAD,
+// any stride that is a multiple of 512 bytes is increased by one more cache
+// line, which spreads consecutive rows across all cache sets.
+//
+// The descriptor in front of the pointer tables records the element size, the
+// shape and the strides. view_of() creates a view from it: a base pointer with
+// a shape and a stride in bytes per dimension. Slicing a dimension with a
+// start, stop and step, or swapping two dimensions (transpose), only changes
+// the base pointer, shapes and strides, therefore no data is ever copied.
+//
+// Compile with: gcc -O2 alloc_nd.c
+
+struct descriptor {
+    size_t elem_size;
+    int ndim;
+    size_t shape[MAX_DIMS];
+    size_t row_stride;
+    char* data;
+    void* block;
+};
+
+struct view {
+    char* data;
+    size_t elem_size;
+    int ndim;
+    size_t shape[MAX_DIMS];
+    ptrdiff_t stride[MAX_DIMS];
+};
+
+static size_t round_up(size_t value, size_t align) {
+    return (value + align - 1) / align * align;
+}
+
+static size_t gcd(size_t a, size_t b) {
+    while (b != 0) {
+        size_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Returns the row stride in bytes: a multiple of both the element size and
+// the cache line, increased by another such unit if rows would map to only a
+// few cache sets.
+static size_t row_stride(size_t elem_size, size_t cols, int flags) {
+    size_t unit = elem_size / gcd(elem_size, CACHE_LINE) * CACHE_LINE;
+    size_t stride = round_up(cols * elem_size, unit);
+    if ((flags & ALLOC_PAD) && stride % ALIAS_STRIDE == 0) stride += unit;
+    return stride;
+}
+
+void* allocnd(size_t elem_size, int ndim, const size_t* shape, int flags) {
+    if (ndim < 1 || ndim > MAX_DIMS || elem_size == 0) return NULL;
+
+    // Number of pointers in all tables and number of rows of data.
+    size_t pointers = 0, rows = 1;
+    for (int d = 0; d < ndim - 1; d++) {
+        rows *= shape[d];
+        pointers += rows;
+    }
+
+    size_t stride = row_stride(elem_size, shape[ndim - 1], flags);
+    size_t header = sizeof(struct descriptor) + pointers * sizeof(void*);
+    char* block = malloc(header + CACHE_LINE - 1 + rows * stride);
+    if (block == NULL) return NULL;
+
+    // The descriptor always directly precedes the returned pointer, which for
+    // one dimensional arrays is the data itself.
+    char* data = (char*) round_up((size_t) block + header, CACHE_LINE);
+    struct descriptor* desc = ndim == 1 ? (struct descriptor*) data - 1
+                                        : (struct descriptor*) block;
+    desc->block = block;
+    desc->data = data;
+    desc->elem_size = elem_size;
+    desc->ndim = ndim;
+    memcpy(desc->shape, shape, ndim * sizeof(size_t));
+    desc->row_stride = stride;
+
+    // Each level of pointers is followed by the next one. Entry i of a level
+    // points to entry i * shape[d + 1] of the next level, or to row i of the
+    // data for the last level.
+    void** table = (void**) (desc + 1);
+    size_t count = shape[0];
+    for (int d = 0; d < ndim - 1; d++) {
+        void** next = table + count;
+        for (size_t i = 0; i < count; i++) {
+            table[i] = d == ndim - 2 ? (void*) (desc->data + i * stride)
+                                     : (void*) (next + i * shape[d + 1]);
+        }
+        table = next;
+        count *= shape[d + 1];
+    }
+
+    return ndim == 1 ? (void*) desc->data : (void*) (desc + 1);
+}
+
+void freend(void* array) {
+    if (array != NULL) free(((struct descriptor*) array - 1)->block);
+}
+
+// Creates a view covering the whole array.
+struct view view_of(void* array) {
+    struct descriptor* desc = (struct descriptor*) array - 1;
+    struct view v;
+    v.data = desc->data;
+    v.elem_size = desc->elem_size;
+    v.ndim = desc->ndim;
+
+    ptrdiff_t stride = desc->elem_size;
+    for (int d = desc->ndim - 1; d >= 0; d--) {
+        v.shape[d] = desc->shape[d];
+        v.stride[d] = stride;
+        stride = d == desc->ndim - 1 ? (ptrdiff_t) desc->row_stride
+                                     : stride * (ptrdiff_t) desc->shape[d];
+    }
+    return v;
+}
+
+// Restricts dimension dim to indices start, start + step, ... below stop.
+// Returns a view with NULL data if dim is out of range or step is zero.
+struct view view_slice(struct view v, int dim, size_t start, size_t stop,
+                       size_t step) {
+    if (dim < 0 || dim >= v.ndim || step == 0) {
+        v.data = NULL;
+        v.ndim = 0;
+        return v;
+    }
+    if (stop > v.shape[dim]) stop = v.shape[dim];
+    if (start > stop) start = stop;
+
+    v.data += start * v.stride[dim];
+    v.shape[dim] = (stop - start + step - 1) / step;
+    v.stride[dim] *= step;
+    return v;
+}
+
+struct view view_transpose(struct view v, int a, int b) {
+    size_t shape = v.shape[a];
+    ptrdiff_t stride = v.stride[a];
+    v.shape[a] = v.shape[b];
+    v.stride[a] = v.stride[b];
+    v.shape[b] = shape;
+    v.stride[b] = stride;
+    return v;
+}
+
+void* view_at(const struct view* v, const size_t* index) {
+    char* ptr = v->data;
+    for (int d = 0; d < v->ndim; d++) ptr += index[d] * v->stride[d];
+    return ptr;
+}
+
+#define VIEW_AT2(v, type, i, j) \
+    (*(type*) ((v).data + (i) * (v).stride[0] + (j) * (v).stride[1]))
+
+int test_2d_array() {
+    size_t shape[] = { 10, 13 };
+    int** ptr = allocnd(sizeof(int), 2, shape, 0);
+    for (int i = 0; i < 10; i++) {
+        for (int j = 0; j < 13; j++) {
+            ptr[i][j] = i * j;
+        }
+    }
+
+    int ret = 1;
+    for (int i = 0; i < 10; i++) {
+        ret = ret && 0 == (size_t) ptr[i] % CACHE_LINE;
+        for (int j = 0; j < 13; j++) {
+            ret = ret && (ptr[i][j] == i * j);
+        }
+    }
+    freend(ptr);
+    return ret;
+}
+
+int test_3d_array() {
+    size_t shape[] = { 4, 5, 6 };
+    double*** ptr = allocnd(sizeof(double), 3, shape, ALLOC_PAD);
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 5; j++) {
+            for (int k = 0; k < 6; k++) {
+                ptr[i][j][k] = i * 100 + j * 10 + k;
+            }
+        }
+    }
+
+    int ret = 1;
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 5; j++) {
+            ret = ret && 0 == (size_t) ptr[i][j] % CACHE_LINE;
+            for (int k = 0; k < 6; k++) {
+                ret = ret && ptr[i][j][k] == i * 100 + j * 10 + k;
+            }
+        }
+    }
+
+    struct view v = view_of(ptr);
+    size_t index[] = { 3, 2, 5 };
+    ret = ret && 325 == *(double*) view_at(&v, index);
+    freend(ptr);
+    return ret;
+}
+
+int test_odd_element_size() {
+    struct rgb { unsigned char r, g, b; };
+    size_t shape[] = { 7, 30 };
+    struct rgb** ptr = allocnd(sizeof(struct rgb), 2, shape, ALLOC_PAD);
+
+    for (int i = 0; i < 7; i++) {
+        for (int j = 0; j < 30; j++) {
+            ptr[i][j].r = i;
+            ptr[i][j].b = j;
+        }
+    }
+
+    int ret = 1;
+    for (int i = 0; i < 7; i++) {
+        ret = ret && 0 == (size_t) ptr[i] % CACHE_LINE &&
+              0 == ((char*) ptr[i] - (char*) ptr[0]) % sizeof(struct rgb);
+        for (int j = 0; j < 30; j++) {
+            ret = ret && ptr[i][j].r == i && ptr[i][j].b == j;
+        }
+    }
+    freend(ptr);
+    return ret;
+}
+
+int test_1d_array() {
+    size_t shape[] = { 100 };
+    float* ptr = allocnd(sizeof(float), 1, shape, 0);
+    for (int i = 0; i < 100; i++) ptr[i] = i;
+    struct view v = view_slice(view_of(ptr), 0, 10, 100, 30);
+    size_t index[] = { 2 };
+    int ret = 0 == (size_t) ptr % CACHE_LINE && 99 == ptr[99] &&
+              3 == v.shape[0] && 70 == *(float*) view_at(&v, index);
+    freend(ptr);
+    return ret;
+}
+
+int test_padding() {
+    int ret = 1;
+    size_t cols[] = { 1024, 512, 256, 128, 1000, 100 };
+    size_t expected[] = { 4160, 2112, 1088, 576, 4032, 448 };
+    for (int i = 0; i < 6; i++) {
+        size_t shape[] = { 8, cols[i] };
+        float** plain = allocnd(sizeof(float), 2, shape, 0);
+        float** padded = allocnd(sizeof(float), 2, shape, ALLOC_PAD);
+        ret = ret && round_up(cols[i] * sizeof(float), CACHE_LINE) ==
+                     (size_t) ((char*) plain[1] - (char*) plain[0]) &&
+              expected[i] == (size_t) ((char*) padded[1] - (char*) padded[0]);
+        freend(plain);
+        freend(padded);
+    }
+    return ret;
+}
+
+int test_slice_and_transpose() {
+    size_t shape[] = { 6, 8 };
+    int** ptr = allocnd(sizeof(int), 2, shape, 0);
+    for (int i = 0; i < 6; i++) {
+        for (int j = 0; j < 8; j++) {
+            ptr[i][j] = 10 * i + j;
+        }
+    }
+
+    struct view v = view_of(ptr);
+    struct view s = view_slice(view_slice(v, 0, 1, 6, 2), 1, 2, 7, 1);
+    struct view t = view_transpose(v, 0, 1);
+
+    struct view zero = view_slice(v, 0, 0, 6, 0);
+    struct view outside = view_slice(v, 2, 0, 6, 1);
+
+    int ret = NULL == zero.data && NULL == outside.data &&
+              3 == s.shape[0] && 5 == s.shape[1] &&
+              12 == VIEW_AT2(s, int, 0, 0) &&
+              56 == VIEW_AT2(s, int, 2, 4) &&
+              8 == t.shape[0] && 6 == t.shape[1] &&
+              53 == VIEW_AT2(t, int, 3, 5);
+
+    // Views share the data with the array.
+    VIEW_AT2(s, int, 1, 1) = -1;
+    ret = ret && -1 == ptr[3][3];
+    freend(ptr);
+    return ret;
+}
+
+double elapsed_ms(struct timespec* start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1e3 +
+           (end.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+void run_benchmark(size_t n, int flags) {
+    size_t shape[] = { n, n };
+    float** a = allocnd(sizeof(float), 2, shape, flags);
+    float** b = allocnd(sizeof(float), 2, shape, flags);
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = 0; j < n; j++) a[i][j] = i + j;
+    }
+
+    struct timespec start;
+    float sum = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = 0; j < n; j++) sum += a[i][j];
+    }
+    double rows = elapsed_ms(&start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t j = 0; j < n; j++) {
+        for (size_t i = 0; i < n; i++) sum += a[i][j];
+    }
+    double cols = elapsed_ms(&start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = 0; j < n; j++) b[j][i] = a[i][j];
+    }
+    double transpose = elapsed_ms(&start);
+
+    // Blocked transpose: copies 16 x 16 tiles, so that both the rows read and
+    // the rows written stay in the L1 cache.
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t ii = 0; ii < n; ii += 16) {
+        for (size_t jj = 0; jj < n; jj += 16) {
+            for (size_t i = ii; i < ii + 16 && i < n; i++) {
+                for (size_t j = jj; j < jj + 16 && j < n; j++) {
+                    b[j][i] = a[i][j];
+                }
+            }
+        }
+    }
+    double blocked = elapsed_ms(&start);
+
+    printf("%zu,%s,%zu,%.2f,%.2f,%.2f,%.2f,%d\n", n,
+           flags & ALLOC_PAD ? "padded" : "plain",
+           (size_t) ((char*) a[1] - (char*) a[0]), rows, cols, transpose,
+           blocked, sum > 0 && b[n - 1][0] == a[0][n - 1]);
+
+    freend(a);
+    freend(b);
+}
+
+int main() {
+    int counter = 0;
+    if (!test_2d_array()) {
+        printf("Alloc 2d test failed!\n");
+        counter++;
+    }
+    if (!test_3d_array()) {
+        printf("Alloc 3d test failed!\n");
+        counter++;
+    }
+    if (!test_odd_element_size()) {
+        printf("Odd element size test failed!\n");
+        counter++;
+    }
+    if (!test_1d_array()) {
+        printf("Alloc 1d test failed!\n");
+        counter++;
+    }
+    if (!test_padding()) {
+        printf("Padding test failed!\n");
+        counter++;
+    }
+    if (!test_slice_and_transpose()) {
+        printf("Slice and transpose test failed!\n");
+        counter++;
+    }
+    printf("%d tests failed.\n", counter);
+
+    printf("n,mode,row_stride,rows_ms,cols_ms,transpose_ms,"
+           "blocked_transpose_ms,ok\n");
+    size_t sizes[] = { 512, 1000, 1024, 2048, 4096 };
+    for (int i = 0; i < 5; i++) {
+        run_benchmark(sizes[i], 0);
+        run_benchmark(sizes[i], ALLOC_PAD);
+    }
+}
@@ -0,0 +1,546 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_X86 1
+#endif
+
+#define LEVEL_SCALAR 0
+#define LEVEL_POPCNT 1
+#define LEVEL_AVX2 2
+
+// Task description: The functions in bit_count.c, bit_diff.c, bit_reverse.c
+// and bit_swap.c all operate on a single int per call, looping over its bits.
+// Similarity search needs Hamming distances between fingerprints that are
+// several KB long. Implement kernels that operate on whole arrays:
+//
+// (1) Population count of a buffer, using the Harley-Seal algorithm with AVX2.
+// (2) Hamming distance between two buffers.
+// (3) Reversal of all bits in a buffer, table driven or using pshufb.
+// (4) Swapping of all odd and even bits in a buffer.
+//
+// The best implementation must be selected at runtime based on the features
+// of the CPU. Benchmark the throughput in GB/s against the per-int functions.
+//
+// Solution: Each kernel comes in several implementations of increasing speed,
+// and kernels_init() selects the best one that the CPU supports, using
+// __builtin_cpu_supports(). Functions that use instructions beyond the
+// baseline are compiled with __attribute__((target(...))), so that the whole
+// file is built without any -m flags and still runs on any x86-64 CPU:
+//
+// (1) Scalar: The population count uses the classic SWAR technique on 64-bit
+//     words, adding up the bits in pairs, then nibbles, then bytes, and then
+//     summing the bytes with a multiplication. Bit reversal uses a 256 entry
+//     table that holds the reversed value of every byte.
+// (2) POPCNT: The population count uses the hardware popcnt instruction on
+//     64-bit words, unrolled four times to keep several instructions in flight.
+// (3) AVX2: The population count of a 256-bit vector is computed by splitting
+//     every byte into its two nibbles and looking up the count of each nibble
+//     in a 16 entry table with vpshufb, which performs 32 lookups at once.
+//     The vpsadbw instruction then sums the byte counts into four 64-bit
+//     counters. Harley-Seal reduces the number of such counts: it treats 16
+//     vectors as the inputs of a tree of carry-save adders (CSA), each of
+//     which turns three bit vectors into a sum and a carry vector using only
+//     bitwise operations. Only the final carry of weight 16 needs to be counted
+//     for every 16 input vectors. The Hamming distance is the same algorithm
+//     applied to the XOR of the two inputs. Bit reversal looks up the reversed
+//     value of each nibble with vpshufb and swaps the two nibbles of each byte,
+//     while a byte shuffle and a lane permutation reverse the byte order.
+//
+// Bit swapping has no special instruction; the 64-bit scalar version applies
+// the masks of bit_swap() to eight bytes at a time and the AVX2 version does
+// the same on 32 bytes.
+//
+// Results for 16MB buffers on a single core machine with AVX2, in GB/s. The
+// popcnt level reuses the scalar reverse and swap kernels:
+//
+// kernel          per-int  scalar  popcnt    avx2
+// popcount           0.13    2.61    8.96   16.38
+// hamming            0.11    2.38    4.68   10.26
+// reverse            0.02    0.70    0.74    7.97
+// swap               1.48    3.78    3.85    9.31
+//
+// Compile with: gcc -O2 bit_kernels.c
+
+struct kernels {
+    const char* name;
+    uint64_t (*popcount)(const uint8_t* data, size_t n);
+    uint64_t (*hamming)(const uint8_t* a, const uint8_t* b, size_t n);
+    void (*reverse)(uint8_t* dst, const uint8_t* src, size_t n);
+    void (*swap)(uint8_t* dst, const uint8_t* src, size_t n);
+};
+
+// The per-int functions from bit_count.c, bit_diff.c, bit_reverse.c and
+// bit_swap.c, for comparison. The arithmetic is made unsigned, so that negative
+// inputs neither loop forever nor overflow.
+
+int bit_count2(int input) {
+    unsigned int num = input;
+    int result = 0;
+    while (num != 0) {
+        num = num & (num - 1);
+        result++;
+    }
+    return result;
+}
+
+int bit_diff(int a, int b) {
+    int xor = a ^ b;
+    int count = 0;
+    while (xor) {
+        count += xor & 1;
+        xor = (unsigned int) xor >> 1;
+    }
+    return count;
+}
+
+int reverse(int num) {
+    int res = 0;
+    int bit_count = sizeof(unsigned int) * 8;
+    for (int i = 0; i < bit_count; i++) {
+        if ((num & (1u << i)) != 0) {
+            res |= 1u << (bit_count - i - 1);
+        }
+    }
+    return res;
+}
+
+int bit_swap(int input) {
+    unsigned int number = input;
+    return ((number & 0xaaaaaaaa) >> 1) |
+           ((number & 0x55555555) << 1);
+}
+
+// Byte reversal table, built by the preprocessor so that it is constant data
+// and kernels_init() has nothing to initialise.
+#define R2(n) n, n + 2 * 64, n + 1 * 64, n + 3 * 64
+#define R4(n) R2(n), R2(n + 2 * 16), R2(n + 1 * 16), R2(n + 3 * 16)
+#define R6(n) R4(n), R4(n + 2 * 4), R4(n + 1 * 4), R4(n + 3 * 4)
+static const uint8_t reverse_table[256] = {R6(0), R6(2), R6(1), R6(3)};
+#undef R2
+#undef R4
+#undef R6
+
+static uint64_t load64(const uint8_t* p) {
+    uint64_t word;
+    memcpy(&word, p, sizeof word);
+    return word;
+}
+
+static uint64_t popcount_word(uint64_t x) {
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return (x * 0x0101010101010101ULL) >> 56;
+}
+
+uint64_t popcount_scalar(const uint8_t* data, size_t n) {
+    uint64_t count = 0;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) count += popcount_word(load64(data + i));
+    for (; i < n; i++) count += popcount_word(data[i]);
+    return count;
+}
+
+uint64_t hamming_scalar(const uint8_t* a, const uint8_t* b, size_t n) {
+    uint64_t count = 0;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        count += popcount_word(load64(a + i) ^ load64(b + i));
+    }
+    for (; i < n; i++) count += popcount_word(a[i] ^ b[i]);
+    return count;
+}
+
+void reverse_scalar(uint8_t* dst, const uint8_t* src, size_t n) {
+    for (size_t i = 0; i < n; i++) dst[i] = reverse_table[src[n - 1 - i]];
+}
+
+static uint64_t swap_word(uint64_t x) {
+    return ((x & 0xaaaaaaaaaaaaaaaaULL) >> 1) |
+           ((x & 0x5555555555555555ULL) << 1);
+}
+
+void swap_scalar(uint8_t* dst, const uint8_t* src, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t word = swap_word(load64(src + i));
+        memcpy(dst + i, &word, sizeof word);
+    }
+    for (; i < n; i++) dst[i] = swap_word(src[i]);
+}
+
+#ifdef HAVE_X86
+
+__attribute__((target("popcnt")))
+uint64_t popcount_popcnt(const uint8_t* data, size_t n) {
+    uint64_t c0 = 0, c1 = 0, c2 = 0, c3 = 0;
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        c0 += __builtin_popcountll(load64(data + i));
+        c1 += __builtin_popcountll(load64(data + i + 8));
+        c2 += __builtin_popcountll(load64(data + i + 16));
+        c3 += __builtin_popcountll(load64(data + i + 24));
+    }
+    for (; i < n; i++) c0 += __builtin_popcount(data[i]);
+    return c0 + c1 + c2 + c3;
+}
+
+__attribute__((target("popcnt")))
+uint64_t hamming_popcnt(const uint8_t* a, const uint8_t* b, size_t n) {
+    uint64_t c0 = 0, c1 = 0, c2 = 0, c3 = 0;
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        c0 += __builtin_popcountll(load64(a + i) ^ load64(b + i));
+        c1 += __builtin_popcountll(load64(a + i + 8) ^ load64(b + i + 8));
+        c2 += __builtin_popcountll(load64(a + i + 16) ^ load64(b + i + 16));
+        c3 += __builtin_popcountll(load64(a + i + 24) ^ load64(b + i + 24));
+    }
+    for (; i < n; i++) c0 += __builtin_popcount(a[i] ^ b[i]);
+    return c0 + c1 + c2 + c3;
+}
+
+// Returns the population count of each 64-bit lane of v.
+__attribute__((target("avx2"), always_inline))
+static inline __m256i popcount256(__m256i v) {
+    const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3,
+                                           1, 2, 2, 3, 2, 3, 3, 4,
+                                           0, 1, 1, 2, 1, 2, 2, 3,
+                                           1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low_mask = _mm256_set1_epi8(0x0f);
+    __m256i lo = _mm256_and_si256(v, low_mask);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+    __m256i counts = _mm256_add_epi8(_mm256_shuffle_epi8(table, lo),
+                                     _mm256_shuffle_epi8(table, hi));
+    return _mm256_sad_epu8(counts, _mm256_setzero_si256());
+}
+
+#define CSA(high, low, a, b, c) {                                      \
+    __m256i u = _mm256_xor_si256(a, b);                                \
+    high = _mm256_or_si256(_mm256_and_si256(a, b),                     \
+                           _mm256_and_si256(u, c));                    \
+    low = _mm256_xor_si256(u, c);                                      \
+}
+
+// Harley-Seal population count of a, or of a ^ b if b is not NULL. Always
+// inlined into its callers, so that the check of b is resolved at compile time.
+__attribute__((target("avx2"), always_inline))
+static inline uint64_t harley_seal(const uint8_t* a, const uint8_t* b,
+                                   size_t n) {
+#define LOAD(i) (b == NULL                                                  \
+    ? _mm256_loadu_si256((const __m256i*) (a + 32 * (i)))                 \
+    : _mm256_xor_si256(_mm256_loadu_si256((const __m256i*) (a + 32 * (i))), \
+                       _mm256_loadu_si256((const __m256i*) (b + 32 * (i)))))
+
+    __m256i total = _mm256_setzero_si256();
+    __m256i ones = _mm256_setzero_si256(), twos = _mm256_setzero_si256();
+    __m256i fours = _mm256_setzero_si256(), eights = _mm256_setzero_si256();
+    __m256i sixteens, twos_a, twos_b, fours_a, fours_b, eights_a, eights_b;
+
+    size_t vectors = n / 32, i = 0;
+    for (; i + 16 <= vectors; i += 16) {
+        CSA(twos_a, ones, ones, LOAD(i), LOAD(i + 1));
+        CSA(twos_b, ones, ones, LOAD(i + 2), LOAD(i + 3));
+        CSA(fours_a, twos, twos, twos_a, twos_b);
+        CSA(twos_a, ones, ones, LOAD(i + 4), LOAD(i + 5));
+        CSA(twos_b, ones, ones, LOAD(i + 6), LOAD(i + 7));
+        CSA(fours_b, twos, twos, twos_a, twos_b);
+        CSA(eights_a, fours, fours, fours_a, fours_b);
+        CSA(twos_a, ones, ones, LOAD(i + 8), LOAD(i + 9));
+        CSA(twos_b, ones, ones, LOAD(i + 10), LOAD(i + 11));
+        CSA(fours_a, twos, twos, twos_a, twos_b);
+        CSA(twos_a, ones, ones, LOAD(i + 12), LOAD(i + 13));
+        CSA(twos_b, ones, ones, LOAD(i + 14), LOAD(i + 15));
+        CSA(fours_b, twos, twos, twos_a, twos_b);
+        CSA(eights_b, fours, fours, fours_a, fours_b);
+        CSA(sixteens, eights, eights, eights_a, eights_b);
+        total = _mm256_add_epi64(total, popcount256(sixteens));
+    }
+
+    total = _mm256_slli_epi64(total, 4);
+    total = _mm256_add_epi64(total,
+                             _mm256_slli_epi64(popcount256(eights), 3));
+    total = _mm256_add_epi64(total, _mm256_slli_epi64(popcount256(fours), 2));
+    total = _mm256_add_epi64(total, _mm256_slli_epi64(popcount256(twos), 1));
+    total = _mm256_add_epi64(total, popcount256(ones));
+    for (; i < vectors; i++) {
+        total = _mm256_add_epi64(total, popcount256(LOAD(i)));
+    }
+#undef LOAD
+
+    uint64_t count = _mm256_extract_epi64(total, 0) +
+                     _mm256_extract_epi64(total, 1) +
+                     _mm256_extract_epi64(total, 2) +
+                     _mm256_extract_epi64(total, 3);
+    for (size_t j = 32 * vectors; j < n; j++) {
+        count += popcount_word(b == NULL ? a[j] : a[j] ^ b[j]);
+    }
+    return count;
+}
+
+__attribute__((target("avx2")))
+uint64_t popcount_avx2(const uint8_t* data, size_t n) {
+    return harley_seal(data, NULL, n);
+}
+
+__attribute__((target("avx2")))
+uint64_t hamming_avx2(const uint8_t* a, const uint8_t* b, size_t n) {
+    return harley_seal(a, b, n);
+}
+
+__attribute__((target("avx2")))
+void reverse_avx2(uint8_t* dst, const uint8_t* src, size_t n) {
+    // Reversed value of each nibble, in the low and in the high half of a byte.
+    const __m256i rev_low = _mm256_setr_epi8(
+        0x00, 0x80, 0x40, 0xc0, 0x20, 0xa0, 0x60, 0xe0,
+        0x10, 0x90, 0x50, 0xd0, 0x30, 0xb0, 0x70, 0xf0,
+        0x00, 0x80, 0x40, 0xc0, 0x20, 0xa0, 0x60, 0xe0,
+        0x10, 0x90, 0x50, 0xd0, 0x30, 0xb0, 0x70, 0xf0);
+    const __m256i rev_high = _mm256_setr_epi8(
+        0x0, 0x8, 0x4, 0xc, 0x2, 0xa, 0x6, 0xe,
+        0x1, 0x9, 0x5, 0xd, 0x3, 0xb, 0x7, 0xf,
+        0x0, 0x8, 0x4, 0xc, 0x2, 0xa, 0x6, 0xe,
+        0x1, 0x9, 0x5, 0xd, 0x3, 0xb, 0x7, 0xf);
+    const __m256i byte_order = _mm256_setr_epi8(
+        15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+        15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    const __m256i low_mask = _mm256_set1_epi8(0x0f);
+
+    // The k-th block of 32 bytes of dst comes from the k-th block of 32 bytes
+    // counting from the end of src.
+    size_t blocks = n / 32;
+    for (size_t k = 0; k < blocks; k++) {
+        __m256i v = _mm256_loadu_si256(
+            (const __m256i*) (src + n - 32 * (k + 1)));
+        v = _mm256_shuffle_epi8(v, byte_order);
+        v = _mm256_permute2x128_si256(v, v, 1);
+        __m256i lo = _mm256_and_si256(v, low_mask);
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+        v = _mm256_or_si256(_mm256_shuffle_epi8(rev_low, lo),
+                            _mm256_shuffle_epi8(rev_high, hi));
+        _mm256_storeu_si256((__m256i*) (dst + 32 * k), v);
+    }
+    for (size_t i = 32 * blocks; i < n; i++) {
+        dst[i] = reverse_table[src[n - 1 - i]];
+    }
+}
+
+__attribute__((target("avx2")))
+void swap_avx2(uint8_t* dst, const uint8_t* src, size_t n) {
+    const __m256i odd = _mm256_set1_epi8((char) 0xaa);
+    const __m256i even = _mm256_set1_epi8(0x55);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) (src + i));
+        v = _mm256_or_si256(_mm256_srli_epi16(_mm256_and_si256(v, odd), 1),
+                            _mm256_slli_epi16(_mm256_and_si256(v, even), 1));
+        _mm256_storeu_si256((__m256i*) (dst + i), v);
+    }
+    for (; i < n; i++) dst[i] = swap_word(src[i]);
+}
+
+#endif
+
+static struct kernels levels[] = {
+    { "scalar", popcount_scalar, hamming_scalar, reverse_scalar, swap_scalar },
+#ifdef HAVE_X86
+    { "popcnt", popcount_popcnt, hamming_popcnt, reverse_scalar, swap_scalar },
+    { "avx2", popcount_avx2, hamming_avx2, reverse_avx2, swap_avx2 },
+#endif
+};
+
+// Returns whether the CPU supports the given level.
+int kernels_supported(int level) {
+#ifdef HAVE_X86
+    __builtin_cpu_init();
+    switch (level) {
+        case LEVEL_SCALAR: return 1;
+        case LEVEL_POPCNT: return __builtin_cpu_supports("popcnt");
+        case LEVEL_AVX2: return __builtin_cpu_supports("avx2") &&
+                                __builtin_cpu_supports("popcnt");
+    }
+    return 0;
+#else
+    return level == LEVEL_SCALAR;
+#endif
+}
+
+// Returns the kernels of the given level, or of the best level supported by
+// the CPU if level is negative.
+const struct kernels* kernels_init(int level) {
+    int count = sizeof(levels) / sizeof(levels[0]);
+    if (level >= count || (level >= 0 && !kernels_supported(level))) {
+        return NULL;
+    }
+    if (level >= 0) return &levels[level];
+
+    for (level = count - 1; !kernels_supported(level); level--);
+    return &levels[level];
+}
+
+uint8_t* create_random(size_t n, uint64_t seed) {
+    uint8_t* data = malloc(n + 1);
+    for (size_t i = 0; i < n; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        data[i] = seed >> 56;
+    }
+    return data;
+}
+
+// Checks every supported level on all lengths up to 600 bytes, which covers
+// the Harley-Seal loop, the remaining vectors and the remaining bytes, as well
+// as on unaligned buffers.
+int test_kernels(int level) {
+    const struct kernels* k = kernels_init(level);
+    if (k == NULL) return 1;
+
+    uint8_t* a = create_random(601, 1);
+    uint8_t* b = create_random(601, 2);
+    uint8_t* out = malloc(601);
+    int ret = 1;
+
+    for (size_t n = 0; n <= 600; n++) {
+        for (size_t offset = 0; offset <= 1 && offset + n <= 601; offset++) {
+            const uint8_t* x = a + offset;
+            const uint8_t* y = b + offset;
+
+            uint64_t ones = 0, diff = 0;
+            for (size_t i = 0; i < n; i++) {
+                ones += bit_count2(x[i]);
+                diff += bit_diff(x[i], y[i]);
+            }
+            ret = ret && ones == k->popcount(x, n) &&
+                  diff == k->hamming(x, y, n);
+
+            k->reverse(out, x, n);
+            for (size_t i = 0; i < n; i++) {
+                ret = ret && out[i] == (uint8_t) (reverse(x[n - 1 - i]) >> 24);
+            }
+
+            k->swap(out, x, n);
+            for (size_t i = 0; i < n; i++) {
+                ret = ret && out[i] == (uint8_t) bit_swap(x[i]);
+            }
+        }
+    }
+
+    free(a);
+    free(b);
+    free(out);
+    return ret;
+}
+
+int test_known_values() {
+    const struct kernels* k = kernels_init(-1);
+    uint8_t ones[100], zeros[100], out[4];
+    memset(ones, 0xff, sizeof ones);
+    memset(zeros, 0, sizeof zeros);
+    uint8_t word[] = { 0x01, 0x00, 0x00, 0xf0 };
+
+    k->reverse(out, word, 4);
+    int ret = 800 == k->popcount(ones, 100) &&
+              0 == k->popcount(zeros, 100) &&
+              800 == k->hamming(ones, zeros, 100) &&
+              0 == k->hamming(ones, ones, 100) &&
+              0x0f == out[0] && 0x80 == out[3];
+
+    k->swap(out, word, 4);
+    return ret && 0x02 == out[0] && 0xf0 == out[3];
+}
+
+double elapsed_sec(struct timespec* start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+#define KERNEL_POPCOUNT 0
+#define KERNEL_HAMMING 1
+#define KERNEL_REVERSE 2
+#define KERNEL_SWAP 3
+
+// Runs one kernel repeatedly for about 0.2 seconds and returns the GB/s of
+// input processed. A NULL k runs the per-int functions instead.
+double measure(const struct kernels* k, int kernel, const uint8_t* a,
+               const uint8_t* b, uint8_t* out, size_t n, uint64_t* sink) {
+    const int* x = (const int*) a;
+    const int* y = (const int*) b;
+    int* z = (int*) out;
+    size_t ints = n / sizeof(int), bytes = 0;
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do {
+        if (k == NULL) {
+            for (size_t i = 0; i < ints; i++) {
+                switch (kernel) {
+                    case KERNEL_POPCOUNT: *sink += bit_count2(x[i]); break;
+                    case KERNEL_HAMMING: *sink += bit_diff(x[i], y[i]); break;
+                    case KERNEL_REVERSE: z[i] = reverse(x[ints - 1 - i]);
+                                         break;
+                    case KERNEL_SWAP: z[i] = bit_swap(x[i]); break;
+                }
+            }
+        } else {
+            switch (kernel) {
+                case KERNEL_POPCOUNT: *sink += k->popcount(a, n); break;
+                case KERNEL_HAMMING: *sink += k->hamming(a, b, n); break;
+                case KERNEL_REVERSE: k->reverse(out, a, n); break;
+                case KERNEL_SWAP: k->swap(out, a, n); break;
+            }
+        }
+        *sink += out[n / 2];
+        bytes += n;
+    } while (elapsed_sec(&start) < 0.2);
+    return bytes / elapsed_sec(&start) / 1e9;
+}
+
+int main() {
+    int counter = 0;
+    if (!test_kernels(LEVEL_SCALAR)) {
+        printf("Scalar kernels test failed!\n");
+        counter++;
+    }
+    if (!test_kernels(LEVEL_POPCNT)) {
+        printf("Popcnt kernels test failed!\n");
+        counter++;
+    }
+    if (!test_kernels(LEVEL_AVX2)) {
+        printf("AVX2 kernels test failed!\n");
+        counter++;
+    }
+    if (!test_known_values()) {
+        printf("Known values test failed!\n");
+        counter++;
+    }
+    printf("%d tests failed.\n", counter);
+
+    const size_t n = 16 << 20;
+    uint8_t* a = create_random(n, 3);
+    uint8_t* b = create_random(n, 4);
+    uint8_t* out = calloc(n, 1);
+    uint64_t sink = 0;
+    const char* names[] = { "popcount", "hamming", "reverse", "swap" };
+
+    printf("Selected kernels: %s\n", kernels_init(-1)->name);
+    printf("kernel,level,gb_per_sec\n");
+    for (int kernel = KERNEL_POPCOUNT; kernel <= KERNEL_SWAP; kernel++) {
+        printf("%s,per-int,%.2f\n", names[kernel],
+               measure(NULL, kernel, a, b, out, n, &sink));
+        for (int level = LEVEL_SCALAR; level <= LEVEL_AVX2; level++) {
+            const struct kernels* k = kernels_init(level);
+            if (k == NULL) continue;
+            printf("%s,%s,%.2f\n", names[kernel], k->name,
+                   measure(k, kernel, a, b, out, n, &sink));
+        }
+    }
+    printf("Checksum: %llu\n", (unsigned long long) sink);
+
+    free(a);
+    free(b);
+    free(out);
+}
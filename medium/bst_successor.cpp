@@ -1,4 +1,11 @@
+#include<algorithm>
+#include<chrono>
+#include<cstdint>
+#include<cstdlib>
 #include<iostream>
+#include<new>
+#include<utility>
+#include<vector>
 
 // Task description: Given a node in a binary search tree, implement a method
 // to find and return the "next" node (its in-order successor). Each tree node
@@ -29,6 +36,37 @@
 //
 // 4) If all steps above have not yielded a successor, it means that the node
 //    is the rightmost node in the tree and does not have a successor at all.
+//
+// Scanning a whole tree this way climbs back up through every parent, and
+// each step is a cache miss on a large tree. ThreadedTree avoids the climb:
+// the right pointer of each node without a right child is a "thread" to its
+// in-order successor, flagged so that it is not mistaken for a child. The
+// successor of a node is then either its thread or the leftmost node of its
+// right subtree, which costs O(1) amortized over a scan and only ever moves
+// forward. Method insert() threads a new left child to its parent and a new
+// right child to the old successor of its parent. Method remove() replaces a
+// node with two children by its successor, and when the removed node has a
+// left subtree, redirects the thread of its predecessor, the rightmost node
+// of that subtree. Method scan(lo, hi, callback) finds the first value not
+// less than lo with a single descent and then follows the successors until it
+// passes hi.
+//
+// On a single core, for 10M random values inserted in random order into a
+// ThreadedTree, and a tree of Nodes with parent pointers of the same shape,
+// built offline and placed in memory in random order. The range scans visit
+// about 100 values each, starting from 100K random values:
+//
+// | method             | build (s) | full scan (s) | range scans (s) |
+// |--------------------|-----------|---------------|-----------------|
+// | get_successor      |      3.29 |          2.91 |            3.32 |
+// | ThreadedTree::scan |     28.22 |          2.57 |            2.73 |
+//
+// Both scans miss the cache once per node. The parents climbed by
+// get_successor() were visited shortly before and are mostly still cached,
+// so the threads save about 12% on a full scan and 18% on range scans.
+//
+// Compile with: g++ -O2 bst_successor.cpp
+// Run with: ./a.out [values]
 
 class Node {
 
@@ -69,6 +107,155 @@ Node* get_successor(Node* node) {
     return 0;
 }
 
+class ThreadedTree {
+
+    private:
+        struct ThreadedNode {
+            int value;
+            bool thread;
+            ThreadedNode* left;
+            ThreadedNode* right;
+        };
+
+        ThreadedNode* root;
+        size_t count;
+
+        static ThreadedNode* leftmost(ThreadedNode* node) {
+            while (node->left) node = node->left;
+            return node;
+        }
+
+        static ThreadedNode* successor(ThreadedNode* node) {
+            return node->thread ? node->right : leftmost(node->right);
+        }
+
+    public:
+        ThreadedTree() : root(0), count(0) { }
+        ThreadedTree(const ThreadedTree&) = delete;
+        ThreadedTree& operator=(const ThreadedTree&) = delete;
+        ~ThreadedTree();
+
+        size_t size() const { return count; }
+        bool insert(int value);
+        bool remove(int value);
+
+        // Calls callback(value) for each value in [lo, hi] in order.
+        template <typename F>
+        void scan(int lo, int hi, F callback) const;
+};
+
+// Frees the nodes in order: the successor of a node never goes back to the
+// nodes before it.
+ThreadedTree::~ThreadedTree() {
+    ThreadedNode* node = root ? leftmost(root) : 0;
+    while (node) {
+        ThreadedNode* next = successor(node);
+        delete node;
+        node = next;
+    }
+}
+
+bool ThreadedTree::insert(int value) {
+    if (!root) {
+        root = new ThreadedNode{ value, true, 0, 0 };
+        count++;
+        return true;
+    }
+
+    ThreadedNode* node = root;
+    while (node->value != value) {
+        if (value < node->value) {
+            if (node->left) {
+                node = node->left;
+                continue;
+            }
+            node->left = new ThreadedNode{ value, true, 0, node };
+        } else {
+            if (!node->thread) {
+                node = node->right;
+                continue;
+            }
+            node->right = new ThreadedNode{ value, true, 0, node->right };
+            node->thread = false;
+        }
+        count++;
+        return true;
+    }
+    return false;
+}
+
+bool ThreadedTree::remove(int value) {
+    ThreadedNode* parent = 0;
+    ThreadedNode* node = root;
+    while (node && node->value != value) {
+        parent = node;
+        if (value < node->value) {
+            node = node->left;
+        } else {
+            node = node->thread ? 0 : node->right;
+        }
+    }
+    if (!node) return false;
+
+    // A node with two children takes the value of its successor, which has no
+    // left child and is removed instead.
+    if (node->left && !node->thread) {
+        ThreadedNode* target = node;
+        parent = node;
+        node = node->right;
+        while (node->left) {
+            parent = node;
+            node = node->left;
+        }
+        target->value = node->value;
+    }
+
+    // Only the predecessor can thread to the node, and only if the node has a
+    // left subtree, whose rightmost node it is.
+    ThreadedNode* replacement;
+    if (node->left) {
+        ThreadedNode* predecessor = node->left;
+        while (!predecessor->thread) predecessor = predecessor->right;
+        predecessor->right = node->right;
+        replacement = node->left;
+    } else {
+        replacement = node->thread ? 0 : node->right;
+    }
+
+    if (!parent) {
+        root = replacement;
+    } else if (parent->left == node) {
+        parent->left = replacement;
+    } else if (replacement) {
+        parent->right = replacement;
+    } else {
+        parent->right = node->right;
+        parent->thread = true;
+    }
+    delete node;
+    count--;
+    return true;
+}
+
+template <typename F>
+void ThreadedTree::scan(int lo, int hi, F callback) const {
+    // The first node not less than lo is the last one whose left subtree the
+    // descent enters.
+    ThreadedNode* first = 0;
+    ThreadedNode* node = root;
+    while (node) {
+        if (node->value >= lo) {
+            first = node;
+            node = node->left;
+        } else {
+            node = node->thread ? 0 : node->right;
+        }
+    }
+    for (node = first; node && node->value <= hi; node = successor(node)) {
+        callback(node->value);
+    }
+}
+
 bool test_null_node() {
     return 0 == get_successor(0);
 }
@@ -100,7 +287,215 @@ bool test_successor() {
            0 == get_successor(&rightright);
 }
 
-int main() {
+bool test_threaded_insert_scan() {
+    ThreadedTree tree;
+    int values[] = { 4, 2, 6, 1, 3, 5, 7, 4 };
+    int inserted = 0;
+    for (int value : values) inserted += tree.insert(value);
+
+    std::vector<int> all, range, empty;
+    tree.scan(0, 10, [&](int value) { all.push_back(value); });
+    tree.scan(3, 5, [&](int value) { range.push_back(value); });
+    tree.scan(8, 10, [&](int value) { empty.push_back(value); });
+    return inserted == 7 && tree.size() == 7 &&
+           all == std::vector<int>({ 1, 2, 3, 4, 5, 6, 7 }) &&
+           range == std::vector<int>({ 3, 4, 5 }) && empty.empty();
+}
+
+bool test_threaded_remove() {
+    ThreadedTree tree;
+    for (int value : { 4, 2, 6, 1, 3, 5, 7 }) tree.insert(value);
+
+    // A node with two children, a leaf and a node with a left child only.
+    bool ret = tree.remove(4) && tree.remove(7) && tree.remove(6) &&
+               !tree.remove(6) && tree.size() == 4;
+    std::vector<int> all;
+    tree.scan(0, 10, [&](int value) { all.push_back(value); });
+    return ret && all == std::vector<int>({ 1, 2, 3, 5 });
+}
+
+bool test_threaded_random() {
+    ThreadedTree tree;
+    std::vector<bool> present(500, false);
+    uint32_t state = 42;
+    bool ret = true;
+    for (int i = 0; i < 100000 && ret; i++) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        int value = state % present.size();
+        if ((state >> 16) % 3 == 0) {
+            ret = tree.remove(value) == present[value];
+            present[value] = false;
+        } else {
+            ret = tree.insert(value) == !present[value];
+            present[value] = true;
+        }
+
+        int lo = (state >> 8) % present.size();
+        int hi = lo + (state >> 20) % 64;
+        std::vector<int> expected, actual;
+        for (int j = lo; j <= hi && j < (int) present.size(); j++) {
+            if (present[j]) expected.push_back(j);
+        }
+        tree.scan(lo, hi, [&](int value) { actual.push_back(value); });
+        ret = ret && expected == actual &&
+              tree.size() == (size_t) std::count(present.begin(),
+                                                 present.end(), true);
+    }
+    return ret;
+}
+
+double elapsed_sec(std::chrono::steady_clock::time_point start) {
+    std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+// Builds the nodes below the i-th smallest value, given the indexes of the
+// children of each value, and sets their parent pointers. The node of the
+// i-th smallest value is placed at pool[slots[i]].
+Node* create_nodes(Node* pool, const std::vector<int>& values,
+                   const std::vector<int>& slots, const std::vector<int>& left,
+                   const std::vector<int>& right, int i) {
+    if (i == -1) return 0;
+    Node* left_node = create_nodes(pool, values, slots, left, right, left[i]);
+    Node* right_node = create_nodes(pool, values, slots, left, right, right[i]);
+    Node* node = new (pool + slots[i]) Node(values[i], left_node, right_node);
+    node->setParent(0);
+    if (left_node) left_node->setParent(node);
+    if (right_node) right_node->setParent(node);
+    return node;
+}
+
+// Builds the tree that inserting the distinct values in the given order into
+// a BST creates, i.e. the tree over the sorted values in which each node was
+// inserted before all nodes below it. The children are found with a stack
+// holding the rightmost path of the tree built so far.
+Node* create_inserted(Node* pool, const std::vector<int>& inserted,
+                      const std::vector<int>& slots) {
+    std::vector< std::pair<int, int> > order;
+    for (size_t i = 0; i < inserted.size(); i++) {
+        order.push_back(std::make_pair(inserted[i], (int) i));
+    }
+    std::sort(order.begin(), order.end());
+    order.erase(std::unique(order.begin(), order.end(),
+                            [](const std::pair<int, int>& a,
+                               const std::pair<int, int>& b) {
+                                return a.first == b.first;
+                            }), order.end());
+
+    std::vector<int> values(order.size()), left(order.size(), -1),
+                     right(order.size(), -1), path;
+    for (int i = 0; i < (int) order.size(); i++) {
+        values[i] = order[i].first;
+        int last = -1;
+        while (!path.empty() && order[path.back()].second > order[i].second) {
+            last = path.back();
+            path.pop_back();
+        }
+        left[i] = last;
+        if (!path.empty()) right[path.back()] = i;
+        path.push_back(i);
+    }
+    return path.empty() ? 0 :
+           create_nodes(pool, values, slots, left, right, path[0]);
+}
+
+// Returns the node with the least value not less than the given one.
+Node* lower_bound(Node* root, int value) {
+    Node* first = 0;
+    while (root) {
+        if (root->getValue() >= value) {
+            first = root;
+            root = root->getLeft();
+        } else {
+            root = root->getRight();
+        }
+    }
+    return first;
+}
+
+void benchmark(int size, int ranges, int width) {
+    std::vector<int> values(size);
+    uint32_t state = 42;
+    for (int& value : values) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        value = state & 0x7fffffff;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    ThreadedTree tree;
+    for (int value : values) tree.insert(value);
+    double threaded_build = elapsed_sec(start);
+
+    std::vector<int> sorted(values);
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+    std::vector<int> slots(sorted.size());
+    for (size_t i = 0; i < slots.size(); i++) slots[i] = i;
+    for (size_t i = slots.size() - 1; i > 0; i--) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        std::swap(slots[i], slots[state % (i + 1)]);
+    }
+    start = std::chrono::steady_clock::now();
+    Node* pool = static_cast<Node*>(::operator new(sorted.size() * sizeof(Node)));
+    Node* root = create_inserted(pool, values, slots);
+    double parent_build = elapsed_sec(start);
+
+    std::vector<int> lows(ranges);
+    for (int& low : lows) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        low = sorted[state % sorted.size()];
+    }
+
+    long checksum = 0;
+    start = std::chrono::steady_clock::now();
+    Node* node = lower_bound(root, 0);
+    for (; node; node = get_successor(node)) checksum += node->getValue();
+    double parent_full = elapsed_sec(start);
+
+    // Each range covers about width values.
+    int span = 0x7fffffff / sorted.size() * width;
+    start = std::chrono::steady_clock::now();
+    for (int low : lows) {
+        node = lower_bound(root, low);
+        int high = std::min(0x7fffffffL, (long) low + span);
+        for (; node && node->getValue() <= high;
+             node = get_successor(node)) {
+            checksum += node->getValue();
+        }
+    }
+    double parent_ranges = elapsed_sec(start);
+    long parent_checksum = checksum;
+    checksum = 0;
+
+    start = std::chrono::steady_clock::now();
+    tree.scan(0, 0x7fffffff, [&](int value) { checksum += value; });
+    double threaded_full = elapsed_sec(start);
+
+    start = std::chrono::steady_clock::now();
+    for (int low : lows) {
+        int high = std::min(0x7fffffffL, (long) low + span);
+        tree.scan(low, high, [&](int value) { checksum += value; });
+    }
+    double threaded_ranges = elapsed_sec(start);
+
+    std::cout << "get_successor," << parent_build << "," << parent_full << ","
+              << parent_ranges << "," << parent_checksum << std::endl;
+    std::cout << "ThreadedTree::scan," << threaded_build << ","
+              << threaded_full << "," << threaded_ranges << "," << checksum
+              << std::endl;
+    ::operator delete(pool);
+}
+
+int main(int argc, char* argv[]) {
     int counter = 0;
     if (!test_null_node()) {
         std::cout << "Null node test failed!" << std::endl;
@@ -110,6 +505,23 @@ int main() {
         std::cout << "Successor test failed!" << std::endl;
         counter++;
     }
+    if (!test_threaded_insert_scan()) {
+        std::cout << "Threaded insert and scan test failed!" << std::endl;
+        counter++;
+    }
+    if (!test_threaded_remove()) {
+        std::cout << "Threaded remove test failed!" << std::endl;
+        counter++;
+    }
+    if (!test_threaded_random()) {
+        std::cout << "Threaded random test failed!" << std::endl;
+        counter++;
+    }
     std::cout << counter << " tests failed." << std::endl;
+
+    int size = argc > 1 ? std::atoi(argv[1]) : 10000000;
+    std::cout << "method,build_sec,full_scan_sec,range_scans_sec,checksum"
+              << std::endl;
+    benchmark(size, 100000, 100);
 }
 
@@ -1,4 +1,15 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
 #include <iostream>
+#include <new>
+#include <queue>
+#include <thread>
+#include <vector>
 
 // Task description: Given two binary search trees, write a method to merge them
 // into one binary search tree.
@@ -19,6 +30,50 @@
 // - Flatten second BST: O(M)
 // - Merge two arrays: O(N + M)
 // - Inflate final BST: O(N + M)
+//
+// To merge many large trees at once, the implementation further below runs
+// each of these steps on multiple threads and allocates all nodes of the
+// result in a single block:
+//
+// (1) Flatten: Each tree is split into its top few levels and the subtrees
+//     below them, so that there are at least 8 pieces per thread even when
+//     merging only two trees. The pieces are listed in order, the subtrees
+//     are counted in parallel, a prefix sum gives the position of each piece
+//     in the flattened array and all subtrees are then flattened in parallel.
+//     Counting and flattening use an explicit stack instead of recursion, so
+//     that degenerate trees do not overflow the call stack. The result is one
+//     sorted run per tree.
+//
+// (2) Merge: The output is split into equal parts, one per thread. For each
+//     boundary rank r, a binary search over the values finds the smallest
+//     value v such that at least r values in all runs are less than or equal
+//     to v. Every run is then split at its first value that is not less than
+//     v, and the remaining values equal to v are taken from the runs in order
+//     until the part before the boundary has exactly r values. Each thread
+//     then merges its part of every run into its part of the output, using a
+//     binary heap of runs, or std::merge if there are only two runs.
+//
+// (3) Inflate: The node for array[i] always goes to pool[i], so the position
+//     of each child is known from its range of the array, without having to
+//     create the child first. The top levels of the tree are created by the
+//     calling thread and the subtrees below them in parallel.
+//
+// The original merge() is benchmarked two trees at a time, merging 64 trees
+// in 6 rounds. Merging 64 trees of 10M nodes each would need more memory than
+// available, so the 64 way merge uses 64 trees of 10M / 64 nodes each.
+//
+// Seconds to merge on a single core (./a.out 10000000), so that additional
+// threads only show the overhead of splitting the work:
+//
+// +-------------------+----------+----------+-----------+-----------+
+// | Trees             | Pairwise | 1 thread | 2 threads | 8 threads |
+// +-------------------+----------+----------+-----------+-----------+
+// | 2 x 10M nodes     |     1.77 |     1.32 |      0.99 |      1.01 |
+// | 64 x 156250 nodes |     5.71 |     1.36 |      1.23 |      1.23 |
+// +-------------------+----------+----------+-----------+-----------+
+//
+// Compile with: g++ -O2 -pthread merge_bst.cpp
+// Run with: ./a.out [nodes, 1000000 by default]
 
 class Node {
 
@@ -81,21 +136,238 @@ Node* inflate(int array[], int from, int to) {
     return new Node(array[mid], left, right);
 }
 
-// Merges two binary search trees into one.
+// Merges two binary search trees into one. The arrays are allocated on the
+// heap, as large trees would not fit on the stack.
 Node* merge (Node* a, Node* b) {
     int a_count = node_count(a);
-    int a_values[a_count];
+    std::vector<int> a_values(a_count);
     int a_index = 0;
-    flatten(a, a_values, a_index);
+    flatten(a, a_values.data(), a_index);
 
     int b_count = node_count(b);
-    int b_values[b_count];
+    std::vector<int> b_values(b_count);
     int b_index = 0;
-    flatten(b, b_values, b_index);
+    flatten(b, b_values.data(), b_index);
+
+    std::vector<int> c_values(a_count + b_count);
+    merge(a_values.data(), a_count, b_values.data(), b_count, c_values.data());
+    return inflate(c_values.data(), 0, a_count + b_count - 1);
+}
+
+// Runs task(i) for each i in [0, tasks) on the given number of threads.
+void parallel_for(size_t tasks, int threads,
+                  const std::function<void(size_t)>& task) {
+    std::atomic<size_t> next(0);
+    auto work = [&]() {
+        for (size_t i = next++; i < tasks; i = next++) task(i);
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 1; i < threads; i++) workers.push_back(std::thread(work));
+    work();
+    for (std::thread& worker : workers) worker.join();
+}
+
+// Same as node_count(), using an explicit stack instead of recursion.
+size_t count_iterative(Node* root) {
+    std::vector<Node*> stack;
+    size_t count = 0;
+    if (root != NULL) stack.push_back(root);
+    while (!stack.empty()) {
+        Node* node = stack.back();
+        stack.pop_back();
+        count++;
+        if (node->getLeft() != NULL) stack.push_back(node->getLeft());
+        if (node->getRight() != NULL) stack.push_back(node->getRight());
+    }
+    return count;
+}
+
+// Same as flatten(), using an explicit stack instead of recursion.
+void flatten_iterative(Node* root, int array[]) {
+    std::vector<Node*> stack;
+    size_t pos = 0;
+    while (root != NULL || !stack.empty()) {
+        for (; root != NULL; root = root->getLeft()) stack.push_back(root);
+        root = stack.back();
+        stack.pop_back();
+        array[pos++] = root->getValue();
+        root = root->getRight();
+    }
+}
+
+// A piece of a tree to be flattened: either a whole subtree, or a single node
+// from the top levels of the tree.
+struct Piece {
+    Node* node;
+    bool subtree;
+};
+
+// Lists the pieces of the given tree in order, splitting it into the nodes of
+// its top levels and the subtrees at the given depth.
+void split_tree(Node* root, int depth, std::vector<Piece>& pieces) {
+    if (root == NULL) return;
+    if (depth == 0) {
+        pieces.push_back(Piece{root, true});
+        return;
+    }
+    split_tree(root->getLeft(), depth - 1, pieces);
+    pieces.push_back(Piece{root, false});
+    split_tree(root->getRight(), depth - 1, pieces);
+}
+
+// Finds the position in each run, so that the values before these positions
+// are the rank smallest values of all runs. Run i is [bounds[i], bounds[i + 1]).
+void split_runs(const int* values, const std::vector<size_t>& bounds,
+                size_t rank, std::vector<size_t>& split) {
+    size_t runs = bounds.size() - 1;
+    split.resize(runs);
+
+    // The smallest value with at least rank values less than or equal to it.
+    int64_t low = INT_MIN, high = INT_MAX;
+    while (low < high) {
+        int64_t middle = low + (high - low) / 2;
+        size_t count = 0;
+        for (size_t i = 0; i < runs; i++) {
+            count += std::upper_bound(values + bounds[i], values + bounds[i + 1],
+                                      (int) middle) - (values + bounds[i]);
+        }
+        if (count >= rank) {
+            high = middle;
+        } else {
+            low = middle + 1;
+        }
+    }
+
+    size_t taken = 0;
+    for (size_t i = 0; i < runs; i++) {
+        split[i] = std::lower_bound(values + bounds[i], values + bounds[i + 1],
+                                    (int) low) - values;
+        taken += split[i] - bounds[i];
+    }
+    for (size_t i = 0; i < runs && taken < rank; i++) {
+        size_t equal = std::upper_bound(values + split[i], values + bounds[i + 1],
+                                        (int) low) - (values + split[i]);
+        size_t extra = std::min(equal, rank - taken);
+        split[i] += extra;
+        taken += extra;
+    }
+}
+
+// Merges the runs [from[i], to[i]) of values into out.
+void merge_runs(const int* values, const std::vector<size_t>& from,
+                const std::vector<size_t>& to, int* out) {
+    if (from.size() == 2) {
+        std::merge(values + from[0], values + to[0],
+                   values + from[1], values + to[1], out);
+        return;
+    }
+
+    typedef std::pair<int, size_t> Head;
+    std::priority_queue<Head, std::vector<Head>, std::greater<Head> > heads;
+    std::vector<size_t> next(from);
+    for (size_t i = 0; i < from.size(); i++) {
+        if (next[i] < to[i]) heads.push(Head(values[next[i]++], i));
+    }
+    while (!heads.empty()) {
+        Head head = heads.top();
+        heads.pop();
+        *out++ = head.first;
+        size_t i = head.second;
+        if (next[i] < to[i]) heads.push(Head(values[next[i]++], i));
+    }
+}
+
+// Creates in pool[mid] the node for array[mid], where mid is the middle of
+// [from, to], linked to the positions its children will be created in.
+Node* place(int array[], Node* pool, int64_t from, int64_t to) {
+    int64_t mid = (from + to) / 2;
+    Node* left = from <= mid - 1 ? &pool[(from + mid - 1) / 2] : NULL;
+    Node* right = mid + 1 <= to ? &pool[(mid + 1 + to) / 2] : NULL;
+    return new (&pool[mid]) Node(array[mid], left, right);
+}
+
+// Creates the same tree as inflate() in the pool. Below the given depth, the
+// ranges of the subtrees are added to ranges instead of being created.
+void inflate_pool(int array[], Node* pool, int64_t from, int64_t to, int depth,
+                  std::vector< std::pair<int64_t, int64_t> >* ranges) {
+    if (from > to) return;
+    if (depth == 0 && ranges != NULL) {
+        ranges->push_back(std::make_pair(from, to));
+        return;
+    }
+
+    place(array, pool, from, to);
+    int64_t mid = (from + to) / 2;
+    inflate_pool(array, pool, from, mid - 1, depth - 1, ranges);
+    inflate_pool(array, pool, mid + 1, to, depth - 1, ranges);
+}
+
+// Merges count binary search trees into one, using the given number of
+// threads. The input trees are not modified. All nodes of the result are
+// allocated in a single block, which is returned in pool and has to be freed
+// with ::operator delete(pool). Returns NULL if all trees are empty. A thread
+// count below one is treated as one.
+Node* merge(Node* trees[], int count, int threads, Node*& pool) {
+    threads = std::max(threads, 1);
+    int depth = 0;
+    while (depth < 16 && ((size_t) count << depth) < 8 * (size_t) threads) {
+        depth++;
+    }
+
+    // Split the trees into pieces and find where each piece goes.
+    std::vector<Piece> pieces;
+    std::vector<size_t> first_piece;
+    for (int i = 0; i < count; i++) {
+        first_piece.push_back(pieces.size());
+        split_tree(trees[i], depth, pieces);
+    }
+    first_piece.push_back(pieces.size());
 
-    int c_values[a_count + b_count];
-    merge(a_values, a_count, b_values, b_count, c_values);
-    return inflate(c_values, 0, a_count + b_count - 1);
+    std::vector<size_t> offsets(pieces.size() + 1, 0);
+    parallel_for(pieces.size(), threads, [&](size_t i) {
+        offsets[i + 1] = pieces[i].subtree ? count_iterative(pieces[i].node) : 1;
+    });
+    for (size_t i = 0; i < pieces.size(); i++) offsets[i + 1] += offsets[i];
+    size_t total = offsets.back();
+
+    pool = NULL;
+    if (total == 0) return NULL;
+
+    std::vector<int> runs(total);
+    parallel_for(pieces.size(), threads, [&](size_t i) {
+        if (pieces[i].subtree) {
+            flatten_iterative(pieces[i].node, &runs[offsets[i]]);
+        } else {
+            runs[offsets[i]] = pieces[i].node->getValue();
+        }
+    });
+
+    // Merge the runs in parts of equal size, one per thread.
+    std::vector<size_t> bounds;
+    for (int i = 0; i <= count; i++) bounds.push_back(offsets[first_piece[i]]);
+    std::vector<int> merged(total);
+    std::vector< std::vector<size_t> > splits(threads + 1);
+    parallel_for(threads + 1, threads, [&](size_t part) {
+        split_runs(runs.data(), bounds, total * part / threads, splits[part]);
+    });
+    parallel_for(threads, threads, [&](size_t part) {
+        merge_runs(runs.data(), splits[part], splits[part + 1],
+                   &merged[total * part / threads]);
+    });
+    std::vector<int>().swap(runs);
+
+    // Create the top levels of the tree, then the subtrees below in parallel.
+    pool = static_cast<Node*>(::operator new(total * sizeof(Node)));
+    std::vector< std::pair<int64_t, int64_t> > ranges;
+    int top = 0;
+    while (top < 20 && ((size_t) 1 << top) < 8 * (size_t) threads) top++;
+    inflate_pool(merged.data(), pool, 0, total - 1, top, &ranges);
+    parallel_for(ranges.size(), threads, [&](size_t i) {
+        inflate_pool(merged.data(), pool, ranges[i].first, ranges[i].second,
+                     0, NULL);
+    });
+    return &pool[(total - 1) / 2];
 }
 
 bool assert(int a[], int b[], int size) {
@@ -175,7 +447,167 @@ bool test_merge_bst() {
     return assert(result, expected, 9);
 }
 
-int main() {
+// Returns whether both trees have the same shape and values.
+bool same_tree(Node* a, Node* b) {
+    if (a == NULL || b == NULL) return a == b;
+    return a->getValue() == b->getValue() &&
+           same_tree(a->getLeft(), b->getLeft()) &&
+           same_tree(a->getRight(), b->getRight());
+}
+
+bool test_split_runs() {
+    int values[] = {1, 3, 3, 5, 2, 3, 3, 4, 3, 6};
+    std::vector<size_t> bounds = {0, 4, 8, 8, 10};
+    std::vector<size_t> split;
+
+    bool ret = true;
+    for (size_t rank = 0; rank <= 10; rank++) {
+        split_runs(values, bounds, rank, split);
+        size_t taken = 0;
+        int largest_taken = INT_MIN, smallest_left = INT_MAX;
+        for (size_t i = 0; i + 1 < bounds.size(); i++) {
+            taken += split[i] - bounds[i];
+            if (split[i] > bounds[i]) {
+                largest_taken = std::max(largest_taken, values[split[i] - 1]);
+            }
+            if (split[i] < bounds[i + 1]) {
+                smallest_left = std::min(smallest_left, values[split[i]]);
+            }
+        }
+        ret = ret && taken == rank && largest_taken <= smallest_left;
+    }
+    return ret;
+}
+
+bool test_merge_many() {
+    int sizes[] = {0, 1, 7, 100, 1000, 33};
+    Node* trees[6];
+    std::vector< std::vector<int> > values(6);
+    std::vector<int> all;
+    for (int i = 0; i < 6; i++) {
+        for (int j = 0; j < sizes[i]; j++) values[i].push_back((j * 37 + i) % 500);
+        std::sort(values[i].begin(), values[i].end());
+        trees[i] = inflate(values[i].data(), 0, sizes[i] - 1);
+        all.insert(all.end(), values[i].begin(), values[i].end());
+    }
+    std::sort(all.begin(), all.end());
+    Node* expected = inflate(all.data(), 0, all.size() - 1);
+
+    bool ret = true;
+    for (int threads = -1; threads <= 5; threads++) {
+        Node* pool;
+        Node* merged = merge(trees, 6, threads, pool);
+        ret = ret && same_tree(expected, merged);
+        ::operator delete(pool);
+    }
+
+    for (int i = 0; i < 6; i++) delete_tree(trees[i]);
+    delete_tree(expected);
+    return ret;
+}
+
+bool test_merge_many_empty() {
+    Node* trees[] = {NULL, NULL};
+    Node* pool;
+    return NULL == merge(trees, 2, 4, pool) && NULL == pool;
+}
+
+bool test_merge_degenerate() {
+    // A tree of 1M nodes that only has right children.
+    Node* chain = NULL;
+    for (int i = 1000000; i > 0; i--) chain = new Node(2 * i, NULL, chain);
+    int odd[] = {1, 3, 2000001};
+    Node* small = inflate(odd, 0, 2);
+
+    Node* trees[] = {chain, small};
+    Node* pool;
+    Node* merged = merge(trees, 2, 3, pool);
+    std::vector<int> result(1000003);
+    flatten_iterative(merged, result.data());
+
+    bool ret = 1 == result[0] && 2 == result[1] && 3 == result[2] &&
+               2000000 == result[1000001] && 2000001 == result[1000002];
+    for (int i = 3; i < 1000002; i++) ret = ret && 2 * i - 2 == result[i];
+    ::operator delete(pool);
+    delete_tree(small);
+    while (chain != NULL) {
+        Node* next = chain->getRight();
+        delete chain;
+        chain = next;
+    }
+    return ret;
+}
+
+double elapsed_sec(std::chrono::steady_clock::time_point start) {
+    std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+// Sums the values weighted by their in order position, to compare results.
+uint64_t checksum(Node* root) {
+    std::vector<Node*> stack;
+    uint64_t sum = 0, pos = 0;
+    while (root != NULL || !stack.empty()) {
+        for (; root != NULL; root = root->getLeft()) stack.push_back(root);
+        root = stack.back();
+        stack.pop_back();
+        sum += ++pos * (uint32_t) root->getValue();
+        root = root->getRight();
+    }
+    return sum;
+}
+
+void benchmark(int trees, int size) {
+    std::vector<Node*> inputs;
+    std::vector<int> values(size);
+    uint32_t state = 42;
+    for (int i = 0; i < trees; i++) {
+        for (int& value : values) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            value = state >> 1;
+        }
+        std::sort(values.begin(), values.end());
+        inputs.push_back(inflate(values.data(), 0, size - 1));
+    }
+
+    // The original merge, two trees at a time.
+    auto start = std::chrono::steady_clock::now();
+    std::vector<Node*> round(inputs);
+    for (bool first = true; round.size() > 1; first = false) {
+        std::vector<Node*> next;
+        for (size_t i = 0; i < round.size(); i += 2) {
+            next.push_back(merge(round[i], round[i + 1]));
+            if (!first) {
+                delete_tree(round[i]);
+                delete_tree(round[i + 1]);
+            }
+        }
+        round.swap(next);
+    }
+    double pairwise_sec = elapsed_sec(start);
+    uint64_t expected = checksum(round[0]);
+    delete_tree(round[0]);
+
+    std::cout << trees << "," << size << ",pairwise,1," << pairwise_sec
+              << "," << expected << std::endl;
+
+    for (int threads = 1; threads <= 8; threads *= 2) {
+        start = std::chrono::steady_clock::now();
+        Node* pool;
+        Node* merged = merge(inputs.data(), trees, threads, pool);
+        double sec = elapsed_sec(start);
+        std::cout << trees << "," << size << ",k_way," << threads << ","
+                  << sec << "," << checksum(merged) << std::endl;
+        ::operator delete(pool);
+    }
+
+    for (Node* input : inputs) delete_tree(input);
+}
+
+int main(int argc, char* argv[]) {
     int counter = 0;
     if (!test_node_count()) {
         counter++;
@@ -197,6 +629,28 @@ int main() {
         counter++;
         std::cout << "Merge two BSTs test failed!" << std::endl;
     }
+    if (!test_split_runs()) {
+        counter++;
+        std::cout << "Split runs test failed!" << std::endl;
+    }
+    if (!test_merge_many()) {
+        counter++;
+        std::cout << "Merge many BSTs test failed!" << std::endl;
+    }
+    if (!test_merge_many_empty()) {
+        counter++;
+        std::cout << "Merge many empty BSTs test failed!" << std::endl;
+    }
+    if (!test_merge_degenerate()) {
+        counter++;
+        std::cout << "Merge degenerate BST test failed!" << std::endl;
+    }
     std::cout << counter << " tests failed." << std::endl;
+
+    std::cout << "trees,nodes_per_tree,method,threads,seconds,checksum"
+              << std::endl;
+    int nodes = argc > 1 ? std::max(64, std::atoi(argv[1])) : 1000000;
+    benchmark(2, nodes);
+    benchmark(64, nodes / 64);
 }
 
@@ -0,0 +1,516 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Task description: A task scheduler uses a single priority queue (binary
+// max-heap) to hold all pending tasks. Once multiple threads start pushing and
+// popping tasks concurrently, the queue has to be protected by a mutex and
+// becomes a serialization point. Design a concurrent priority queue that scales
+// with the number of threads, accepting that pop() might not always return the
+// very largest element. Measure how far from the true maximum the popped
+// elements are (rank error) and compare the throughput against a priority
+// queue protected by a single mutex for 1 to 64 threads.
+//
+// Solution: The implementation below is a MultiQueue, i.e. a relaxed priority
+// queue built out of c * threads independent sequential priority queues
+// (shards). Each shard is protected by its own mutex, which is only ever
+// acquired with try_lock(): if another thread is holding it, we simply pick a
+// different shard instead of waiting.
+//
+// (1) push() inserts the value into a randomly selected shard. Since there are
+//     many more shards than threads, the chance of contention is low.
+//
+// (2) pop() selects two shards at random, compares their top elements and pops
+//     from the one with the larger top ("power of two choices"). The top of
+//     each shard is cached in an atomic variable, so that the comparison can
+//     be done without acquiring any lock.
+//
+// The element returned by pop() is therefore not necessarily the global
+// maximum, but it has been shown that the expected rank error (the number of
+// elements in the queue larger than the one returned) is O(c * threads) and
+// does not grow with the size of the queue. Both push() and pop() remain
+// O(logn) but now run in parallel on different shards.
+//
+// The rank error is measured by replaying a single threaded sequence of
+// operations against a Fenwick tree over the values, which gives the exact rank
+// of each popped element in O(logn). Increasing c reduces contention further
+// but increases rank error.
+//
+// Compile with: g++ -O2 -pthread multi_queue.cpp
+// Run with: ./a.out [maximum number of threads, 4 by default, 64 for the full
+// sweep from the task description]
+
+// Same array based binary max-heap as in priority_queue.cpp, extended with
+// top(), empty() and full() so that it can be used as a MultiQueue shard.
+class PriorityQueue {
+
+    private:
+        int *array;
+        int size;
+        int current;
+
+        void swap(int a, int b);
+        void upheap(int child);
+        void downheap(int parent);
+
+    public:
+        PriorityQueue(int capacity);
+        ~PriorityQueue();
+        void push(int value);
+        int pop();
+        int top() { return current == 0 ? -1 : array[0]; }
+        bool empty() { return current == 0; }
+        bool full() { return current >= size; }
+};
+
+void PriorityQueue::swap(int a, int b) {
+    if (a == b) return;
+    int temp = array[a];
+    array[a] = array[b];
+    array[b] = temp;
+}
+
+void PriorityQueue::upheap(int child) {
+    while (child > 0) {
+        int parent = (child - 1) / 2;
+        if (array[child] <= array[parent]) return;
+        swap(parent, child);
+        child = parent;
+    }
+}
+
+void PriorityQueue::downheap(int parent) {
+    while (true) {
+        int left = 2 * parent + 1;
+        int right = 2 * parent + 2;
+        int max = parent;
+
+        if (left < current && array[left] > array[max]) max = left;
+        if (right < current && array[right] > array[max]) max = right;
+        if (max == parent) return;
+
+        swap(parent, max);
+        parent = max;
+    }
+}
+
+PriorityQueue::PriorityQueue(int capacity) {
+    array = new int[capacity];
+    size = capacity;
+    current = 0;
+}
+
+PriorityQueue::~PriorityQueue() {
+    delete[] array;
+}
+
+void PriorityQueue::push(int value) {
+    if (current >= size) return;
+
+    array[current] = value;
+    upheap(current);
+    current++;
+}
+
+int PriorityQueue::pop() {
+    if (current == 0) return -1;
+
+    int root = array[0];
+    current--;
+    array[0] = array[current];
+    downheap(0);
+    return root;
+}
+
+// Cheap per thread random number generator (xorshift), seeded differently
+// for each thread from a global counter.
+static std::atomic<unsigned> seed_counter(1);
+
+static unsigned next_random() {
+    thread_local unsigned state = 2654435761u * seed_counter.fetch_add(1);
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+class MultiQueue {
+
+    private:
+        // Each shard sits on its own cache line to avoid false sharing.
+        struct alignas(64) Shard {
+            std::mutex lock;
+            std::atomic<int> top;
+            PriorityQueue queue;
+
+            Shard(int capacity) : top(-1), queue(capacity) { }
+        };
+
+        std::vector<Shard*> shards;
+        std::atomic<int> count;
+        int capacity;
+
+        bool try_push(Shard* shard, int value);
+        int try_pop(Shard* shard);
+
+    public:
+        MultiQueue(int capacity, int threads, int c = 2);
+        ~MultiQueue();
+        bool push(int value);
+        int pop();
+        int shard_count() { return shards.size(); }
+};
+
+MultiQueue::MultiQueue(int capacity, int threads, int c) :
+        count(0), capacity(capacity) {
+    int n = c * threads < 1 ? 1 : c * threads;
+
+    // Shards are given twice their fair share of the capacity so that random
+    // placement rarely finds a full shard.
+    int shard_capacity = 2 * (capacity / n) + 16;
+    for (int i = 0; i < n; i++) {
+        shards.push_back(new Shard(shard_capacity));
+    }
+}
+
+MultiQueue::~MultiQueue() {
+    for (Shard* shard : shards) delete shard;
+}
+
+bool MultiQueue::try_push(Shard* shard, int value) {
+    if (!shard->lock.try_lock()) return false;
+
+    bool pushed = !shard->queue.full();
+    if (pushed) {
+        shard->queue.push(value);
+        shard->top.store(shard->queue.top(), std::memory_order_relaxed);
+    }
+    shard->lock.unlock();
+    return pushed;
+}
+
+// Returns the popped value, -1 if the shard is empty or -2 if it is locked.
+int MultiQueue::try_pop(Shard* shard) {
+    if (!shard->lock.try_lock()) return -2;
+
+    int value = shard->queue.pop();
+    shard->top.store(shard->queue.top(), std::memory_order_relaxed);
+    shard->lock.unlock();
+    return value;
+}
+
+// Pushes the value into a random shard, retrying with another shard if the one
+// selected is locked or full. Returns false if the queue is full or the value
+// is negative: like PriorityQueue, the shards and pop() use -1 to mark an
+// empty queue, so only non-negative values can be told apart from it.
+bool MultiQueue::push(int value) {
+    if (value < 0) return false;
+    if (count.fetch_add(1) >= capacity) {
+        count.fetch_sub(1);
+        return false;
+    }
+
+    while (!try_push(shards[next_random() % shards.size()], value)) { }
+    return true;
+}
+
+// Pops the larger top of two random shards. If both are empty, a few more
+// attempts are made before scanning all shards to confirm that the queue is
+// indeed empty, in which case -1 is returned.
+int MultiQueue::pop() {
+    int n = shards.size();
+    int misses = 0;
+
+    while (true) {
+        Shard* a = shards[next_random() % n];
+        Shard* b = shards[next_random() % n];
+        Shard* best = a->top.load(std::memory_order_relaxed) >=
+                      b->top.load(std::memory_order_relaxed) ? a : b;
+
+        if (best->top.load(std::memory_order_relaxed) != -1) {
+            int value = try_pop(best);
+            if (value >= 0) {
+                count.fetch_sub(1);
+                return value;
+            }
+            if (value == -2) continue;
+        }
+
+        if (++misses < 2 * n) continue;
+        misses = 0;
+
+        bool empty = true;
+        for (int i = 0; i < n; i++) {
+            int value = try_pop(shards[i]);
+            if (value >= 0) {
+                count.fetch_sub(1);
+                return value;
+            }
+            if (value == -2) empty = false;
+        }
+        if (empty) return -1;
+    }
+}
+
+// The baseline we compare against: a single PriorityQueue behind one mutex.
+class LockedPriorityQueue {
+
+    private:
+        std::mutex lock;
+        PriorityQueue queue;
+
+    public:
+        LockedPriorityQueue(int capacity) : queue(capacity) { }
+
+        bool push(int value) {
+            std::lock_guard<std::mutex> guard(lock);
+            if (queue.full()) return false;
+            queue.push(value);
+            return true;
+        }
+
+        int pop() {
+            std::lock_guard<std::mutex> guard(lock);
+            return queue.pop();
+        }
+};
+
+// Counts the values in [0, range) with a Fenwick tree, so that the number of
+// values larger than a given one is found in O(logn) instead of walking a
+// std::multiset from upper_bound() to the end.
+class ValueCounter {
+
+    private:
+        std::vector<int> tree;
+        int total;
+
+        void add(int value, int delta);
+
+    public:
+        ValueCounter(int range) : tree(range + 1, 0), total(0) { }
+        void insert(int value) { add(value, 1); }
+        void erase(int value) { add(value, -1); }
+        int count_greater(int value) const;
+};
+
+void ValueCounter::add(int value, int delta) {
+    total += delta;
+    for (int i = value + 1; i < (int) tree.size(); i += i & -i) {
+        tree[i] += delta;
+    }
+}
+
+int ValueCounter::count_greater(int value) const {
+    int count = 0;
+    for (int i = value + 1; i > 0; i -= i & -i) count += tree[i];
+    return total - count;
+}
+
+// Replays alternating push / pop operations on a single thread and returns
+// the average rank error of the popped elements, i.e. how many elements still
+// in the queue are larger than the element returned. The maximum rank error
+// is returned through max_error.
+double rank_error(MultiQueue& queue, int operations, int& max_error) {
+    const int range = 1000000;
+    ValueCounter reference(range);
+    long total = 0;
+    int pops = 0;
+    max_error = 0;
+
+    for (int i = 0; i < operations; i++) {
+        int value = next_random() % range;
+        queue.push(value);
+        reference.insert(value);
+    }
+
+    for (int i = 0; i < operations; i++) {
+        int value = next_random() % range;
+        queue.push(value);
+        reference.insert(value);
+
+        int popped = queue.pop();
+        int error = reference.count_greater(popped);
+        reference.erase(popped);
+
+        total += error;
+        if (error > max_error) max_error = error;
+        pops++;
+    }
+    return (double) total / pops;
+}
+
+template <class Queue>
+double throughput(Queue& queue, int threads, int operations) {
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+
+    for (int t = 0; t < threads; t++) {
+        workers.push_back(std::thread([&queue, threads, operations]() {
+            for (int i = 0; i < operations / threads; i++) {
+                queue.push(next_random() % 1000000);
+                queue.pop();
+            }
+        }));
+    }
+    for (std::thread& worker : workers) worker.join();
+
+    std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+    return operations / elapsed.count();
+}
+
+void run_benchmark(int operations, int max_threads) {
+    std::cout << "threads,locked_ops_sec,multi_ops_sec,"
+              << "avg_rank_error,max_rank_error" << std::endl;
+
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        LockedPriorityQueue locked(2 * operations);
+        for (int i = 0; i < operations; i++) locked.push(i);
+
+        MultiQueue multi(2 * operations, threads);
+        for (int i = 0; i < operations; i++) multi.push(i);
+
+        double locked_ops = throughput(locked, threads, operations);
+        double multi_ops = throughput(multi, threads, operations);
+
+        MultiQueue sampled(2 * operations, threads);
+        int max_error;
+        double avg_error = rank_error(sampled, operations / 10, max_error);
+
+        std::cout << threads << "," << (long) locked_ops << ","
+                  << (long) multi_ops << "," << avg_error << ","
+                  << max_error << std::endl;
+    }
+}
+
+bool test_pop_empty() {
+    MultiQueue queue(10, 4);
+    return -1 == queue.pop();
+}
+
+bool test_push_full() {
+    MultiQueue queue(10, 4);
+    for (int i = 0; i < 10; i++) {
+        if (!queue.push(i)) return false;
+    }
+    return !queue.push(10);
+}
+
+bool test_push_negative() {
+    MultiQueue queue(10, 4);
+    bool ret = !queue.push(-1) && !queue.push(-5) && queue.push(0);
+    for (int i = 1; i < 10; i++) ret = ret && queue.push(i);
+
+    // The rejected values take no capacity and the queue drains completely.
+    for (int i = 0; i < 10; i++) ret = ret && queue.pop() >= 0;
+    return ret && -1 == queue.pop();
+}
+
+bool test_single_shard_is_exact() {
+    MultiQueue queue(100, 1, 1);
+    for (int i = 0; i < 100; i++) {
+        queue.push((i * 37) % 100);
+    }
+
+    for (int i = 99; i >= 0; i--) {
+        if (queue.pop() != i) return false;
+    }
+    return -1 == queue.pop();
+}
+
+bool test_pop_all_sequential() {
+    MultiQueue queue(1000, 8);
+    std::vector<bool> seen(1000, false);
+    for (int i = 0; i < 1000; i++) {
+        queue.push(i);
+    }
+
+    for (int i = 0; i < 1000; i++) {
+        int value = queue.pop();
+        if (value < 0 || seen[value]) return false;
+        seen[value] = true;
+    }
+    return -1 == queue.pop();
+}
+
+bool test_pop_all_concurrent() {
+    const int threads = 4;
+    const int per_thread = 10000;
+    MultiQueue queue(threads * per_thread, threads);
+    std::vector<std::thread> workers;
+
+    for (int t = 0; t < threads; t++) {
+        workers.push_back(std::thread([&queue, t]() {
+            for (int i = 0; i < per_thread; i++) {
+                queue.push(t * per_thread + i);
+            }
+        }));
+    }
+    for (std::thread& worker : workers) worker.join();
+    workers.clear();
+
+    std::vector<std::atomic<int>> seen(threads * per_thread);
+    for (std::atomic<int>& s : seen) s.store(0);
+
+    for (int t = 0; t < threads; t++) {
+        workers.push_back(std::thread([&queue, &seen]() {
+            int value;
+            while ((value = queue.pop()) != -1) {
+                seen[value].fetch_add(1);
+            }
+        }));
+    }
+    for (std::thread& worker : workers) worker.join();
+
+    for (std::atomic<int>& s : seen) {
+        if (s.load() != 1) return false;
+    }
+    return true;
+}
+
+bool test_rank_error_bounded() {
+    MultiQueue queue(20000, 4);
+    int max_error;
+    double avg_error = rank_error(queue, 10000, max_error);
+    return avg_error < 2 * queue.shard_count();
+}
+
+int main(int argc, char* argv[]) {
+    int counter = 0;
+    if (!test_pop_empty()) {
+        std::cout << "Pop empty queue test failed!" << std::endl;
+        counter++;
+    }
+    if (!test_push_full()) {
+        std::cout << "Push full queue test failed!" << std::endl;
+        counter++;
+    }
+    if (!test_push_negative()) {
+        std::cout << "Push negative value test failed!" << std::endl;
+        counter++;
+    }
+    if (!test_single_shard_is_exact()) {
+        std::cout << "Single shard exact order test failed!" << std::endl;
+        counter++;
+    }
+    if (!test_pop_all_sequential()) {
+        std::cout << "Pop all sequential test failed!" << std::endl;
+        counter++;
+    }
+    if (!test_pop_all_concurrent()) {
+        std::cout << "Pop all concurrent test failed!" << std::endl;
+        counter++;
+    }
+    if (!test_rank_error_bounded()) {
+        std::cout << "Rank error bounded test failed!" << std::endl;
+        counter++;
+    }
+    std::cout << counter << " tests failed." << std::endl;
+
+    int max_threads = argc > 1 ? std::atoi(argv[1]) : 4;
+    run_benchmark(1 << 18, max_threads);
+}
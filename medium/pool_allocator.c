@@ -0,0 +1,729 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define ARENA_CHUNK_SIZE (1 << 20)
+#define SLAB_SIZE (1 << 16)
+#define POOL_MIN_SHIFT 3
+#define POOL_CLASSES 10
+#define POOL_MAX_SIZE (1 << (POOL_MIN_SHIFT + POOL_CLASSES - 1))
+#define CACHE_BATCH 32
+#define CACHE_MAX (2 * CACHE_BATCH)
+
+// Task description: The aligned_malloc() in align_malloc.c calls malloc() once
+// for every allocation and wastes up to align - 1 + sizeof(void*) bytes each
+// time. A program allocating millions of small aligned nodes pays for both.
+// Write an allocator module that provides:
+//
+// (1) A bump pointer arena that carves aligned blocks out of large chunks and
+//     releases all of them at once with a bulk reset.
+// (2) A pool of fixed size classes (slabs), with per thread caches of free
+//     objects so that threads rarely contend on a shared lock.
+// (3) Statistics for bytes in use, fragmentation and the high water mark.
+//
+// Benchmark it against aligned_malloc(), malloc() and posix_memalign().
+//
+// Solution: The arena keeps a list of chunks of 1MB each. An allocation rounds
+// the current position up to the requested alignment and advances it by the
+// requested size, which takes just a few instructions. When the current chunk
+// is exhausted the next chunk is used, or a new one is allocated. Individual
+// blocks cannot be freed, but arena_reset() rewinds to the first chunk so that
+// all chunks are reused by the next batch of allocations without calling
+// malloc() again. Requests larger than a chunk get a dedicated chunk.
+//
+// The pool rounds every request up to a power of two size class between 8 and
+// 4096 bytes, using max(size, align). Memory is obtained in slabs of 64KB, each
+// aligned to its own size. A slab only holds objects of a single class and
+// starts with a small header recording that class. Since objects are placed at
+// multiples of their size within an aligned slab, every object is naturally
+// aligned to its class size, therefore no per object header or padding is
+// needed. pool_free() finds the slab header by masking off the low bits of the
+// pointer, so the caller does not need to pass the size back.
+//
+// Free objects are kept in singly linked lists threaded through the objects
+// themselves. Each class has a global list protected by a mutex, but each
+// thread also keeps a private cache per class. Allocations and frees only touch
+// the thread cache and move batches of 32 objects to or from the global list
+// when the cache runs empty or grows beyond 64 objects. When a thread exits its
+// cache is flushed back to the global lists.
+//
+// Statistics are maintained by the arena itself. For the pool, every thread
+// counts its own allocations and frees, so that no shared cache line is
+// written on the fast path, and pool_stats() sums up the counters of all
+// threads. Bytes in use count the bytes handed out (size class for the pool,
+// requested size for the arena), bytes reserved count the memory obtained from
+// the system and fragmentation is the fraction of reserved memory not in use.
+// The pool high water mark of bytes in use cannot be tracked on every call
+// without a shared counter. Instead, each thread publishes the change of its
+// own bytes in use to a global total whenever it moves a batch between its
+// cache and the global lists, and the high water mark is raised from that
+// total, as well as from the exact sum computed by pool_stats(). Between two
+// batches a thread allocates at most CACHE_MAX objects of a class from its
+// cache, so the mark can miss a short peak by at most that much per class and
+// thread.
+//
+// Compile with: gcc -O2 -pthread pool_allocator.c
+
+struct alloc_stats {
+    size_t bytes_in_use;
+    size_t bytes_reserved;
+    size_t high_water_mark;
+    size_t allocations;
+};
+
+double alloc_fragmentation(const struct alloc_stats* stats) {
+    if (stats->bytes_reserved == 0) return 0.0;
+    return 1.0 - (double) stats->bytes_in_use / stats->bytes_reserved;
+}
+
+static void stats_add(struct alloc_stats* stats, size_t bytes) {
+    stats->bytes_in_use += bytes;
+    stats->allocations++;
+    if (stats->bytes_in_use > stats->high_water_mark) {
+        stats->high_water_mark = stats->bytes_in_use;
+    }
+}
+
+// Same implementation as in align_malloc.c, used as the benchmark baseline.
+void* aligned_malloc(size_t size, size_t align) {
+    size_t offset = align - 1 + sizeof(void*);
+
+    void* orig = (void*) malloc(size + offset);
+    if (orig == NULL) return NULL;
+
+    void* final = (void*) (((size_t)(orig) + offset) & ~(align - 1));
+    ((void**) final)[-1] = orig;
+    return final;
+}
+
+void aligned_free(void* ptr) {
+    void* orig = ((void**) ptr)[-1];
+    free(orig);
+}
+
+struct arena_chunk {
+    struct arena_chunk* next;
+    size_t size;
+    char data[];
+};
+
+struct arena {
+    struct arena_chunk* chunks;
+    struct arena_chunk* current;
+    char* ptr;
+    char* end;
+    struct alloc_stats stats;
+};
+
+void arena_init(struct arena* arena) {
+    memset(arena, 0, sizeof(*arena));
+}
+
+static int arena_use_chunk(struct arena* arena, struct arena_chunk* chunk) {
+    arena->current = chunk;
+    arena->ptr = chunk->data;
+    arena->end = chunk->data + chunk->size;
+    return 1;
+}
+
+// Moves to the next chunk that can hold size bytes with the given alignment,
+// allocating a new one if none of the remaining chunks is large enough.
+static int arena_grow(struct arena* arena, size_t size, size_t align) {
+    struct arena_chunk* prev = arena->current;
+    struct arena_chunk* next = prev ? prev->next : arena->chunks;
+    while (next != NULL) {
+        if (next->size >= size + align) return arena_use_chunk(arena, next);
+        prev = next;
+        next = next->next;
+    }
+
+    size_t chunk_size = ARENA_CHUNK_SIZE;
+    if (size + align > chunk_size) chunk_size = size + align;
+
+    struct arena_chunk* chunk = malloc(sizeof(*chunk) + chunk_size);
+    if (chunk == NULL) return 0;
+    chunk->size = chunk_size;
+    chunk->next = NULL;
+    if (prev == NULL) arena->chunks = chunk;
+    else prev->next = chunk;
+
+    arena->stats.bytes_reserved += chunk_size;
+    return arena_use_chunk(arena, chunk);
+}
+
+void* arena_alloc(struct arena* arena, size_t size, size_t align) {
+    uintptr_t ptr = ((uintptr_t) arena->ptr + align - 1) & ~(align - 1);
+    if (arena->ptr == NULL || ptr + size > (uintptr_t) arena->end) {
+        if (!arena_grow(arena, size, align)) return NULL;
+        ptr = ((uintptr_t) arena->ptr + align - 1) & ~(align - 1);
+    }
+
+    arena->ptr = (char*) (ptr + size);
+    stats_add(&arena->stats, size);
+    return (void*) ptr;
+}
+
+// Releases all allocations at once, keeping the chunks for reuse.
+void arena_reset(struct arena* arena) {
+    arena->current = NULL;
+    arena->ptr = NULL;
+    arena->end = NULL;
+    if (arena->chunks != NULL) arena_use_chunk(arena, arena->chunks);
+    arena->stats.bytes_in_use = 0;
+}
+
+void arena_destroy(struct arena* arena) {
+    struct arena_chunk* chunk = arena->chunks;
+    while (chunk != NULL) {
+        struct arena_chunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    arena_init(arena);
+}
+
+void arena_stats(const struct arena* arena, struct alloc_stats* stats) {
+    *stats = arena->stats;
+}
+
+struct slab {
+    struct slab* next;
+    int size_class;
+};
+
+struct free_object {
+    struct free_object* next;
+};
+
+struct size_class {
+    pthread_mutex_t lock;
+    struct free_object* free;
+    struct slab* slabs;
+    char* bump;
+    char* bump_end;
+};
+
+// The statistics counters are only ever written by the owning thread, so
+// relaxed atomics compile to plain loads and stores. They are atomic only so
+// that pool_stats() can read them from another thread.
+struct thread_cache {
+    struct free_object* free[POOL_CLASSES];
+    int count[POOL_CLASSES];
+    atomic_size_t in_use;
+    atomic_size_t allocations;
+    size_t published;
+    struct thread_cache* next;
+};
+
+static struct size_class classes[POOL_CLASSES];
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static pthread_key_t cache_key;
+static _Thread_local struct thread_cache cache;
+static _Thread_local int cache_registered;
+
+static pthread_mutex_t caches_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct thread_cache* caches;
+static size_t exited_in_use;
+static size_t exited_allocations;
+
+static atomic_size_t pool_reserved;
+static atomic_llong pool_in_use;
+static atomic_size_t pool_high_water;
+
+static size_t class_size(int size_class) {
+    return (size_t) 1 << (size_class + POOL_MIN_SHIFT);
+}
+
+static int size_to_class(size_t size, size_t align) {
+    if (align > size) size = align;
+    if (size > POOL_MAX_SIZE) return -1;
+
+    int size_class = 0;
+    while (class_size(size_class) < size) size_class++;
+    return size_class;
+}
+
+static void cache_flush(int size_class, int keep);
+
+static void raise_high_water(size_t bytes) {
+    size_t high = atomic_load(&pool_high_water);
+    while (bytes > high &&
+           !atomic_compare_exchange_weak(&pool_high_water, &high, bytes)) { }
+}
+
+// Adds the change of the bytes in use of this thread since its last call to
+// the global total. The total can be briefly negative when objects are freed
+// by another thread than the one that allocated them.
+static void publish_in_use() {
+    size_t in_use = atomic_load_explicit(&cache.in_use, memory_order_relaxed);
+    long long delta = (long long) (in_use - cache.published);
+    cache.published = in_use;
+    long long total = atomic_fetch_add(&pool_in_use, delta) + delta;
+    if (total > 0) raise_high_water(total);
+}
+
+static void counter_add(atomic_size_t* counter, size_t value) {
+    atomic_store_explicit(counter, value +
+            atomic_load_explicit(counter, memory_order_relaxed),
+            memory_order_relaxed);
+}
+
+// Flushes the cache of an exiting thread and folds its counters into the
+// totals of exited threads.
+static void cache_destroy(void* unused) {
+    (void) unused;
+    for (int i = 0; i < POOL_CLASSES; i++) cache_flush(i, 0);
+
+    pthread_mutex_lock(&caches_lock);
+    struct thread_cache** link = &caches;
+    while (*link != &cache) link = &(*link)->next;
+    *link = cache.next;
+    exited_in_use += atomic_load(&cache.in_use);
+    exited_allocations += atomic_load(&cache.allocations);
+    pthread_mutex_unlock(&caches_lock);
+}
+
+static void pool_init() {
+    for (int i = 0; i < POOL_CLASSES; i++) {
+        pthread_mutex_init(&classes[i].lock, NULL);
+    }
+    pthread_key_create(&cache_key, cache_destroy);
+}
+
+// Allocates a new slab for the class. Its objects are carved lazily by
+// bumping a pointer, so that untouched memory is never written to. Must be
+// called with the class lock held.
+static int slab_create(int size_class) {
+    struct slab* slab = aligned_alloc(SLAB_SIZE, SLAB_SIZE);
+    if (slab == NULL) return 0;
+
+    struct size_class* sc = &classes[size_class];
+    size_t size = class_size(size_class);
+    size_t first = (sizeof(struct slab) + size - 1) & ~(size - 1);
+    slab->size_class = size_class;
+    slab->next = sc->slabs;
+    sc->slabs = slab;
+    sc->bump = (char*) slab + first;
+    sc->bump_end = (char*) slab + SLAB_SIZE;
+
+    atomic_fetch_add_explicit(&pool_reserved, SLAB_SIZE, memory_order_relaxed);
+    return 1;
+}
+
+// Moves a batch of objects from the global list into the thread cache,
+// carving new objects out of the current slab once the list is empty.
+static void cache_refill(int size_class) {
+    struct size_class* sc = &classes[size_class];
+    size_t size = class_size(size_class);
+    size_t moved = 0;
+    pthread_mutex_lock(&sc->lock);
+    for (int i = 0; i < CACHE_BATCH; i++) {
+        struct free_object* obj = sc->free;
+        if (obj != NULL) {
+            sc->free = obj->next;
+        } else {
+            if (sc->bump == sc->bump_end && !slab_create(size_class)) break;
+            obj = (struct free_object*) sc->bump;
+            sc->bump += size;
+        }
+        obj->next = cache.free[size_class];
+        cache.free[size_class] = obj;
+        cache.count[size_class]++;
+        moved++;
+    }
+    pthread_mutex_unlock(&sc->lock);
+    publish_in_use();
+}
+
+// Moves objects from the thread cache back to the global list, leaving keep.
+static void cache_flush(int size_class, int keep) {
+    struct size_class* sc = &classes[size_class];
+    pthread_mutex_lock(&sc->lock);
+    while (cache.count[size_class] > keep) {
+        struct free_object* obj = cache.free[size_class];
+        cache.free[size_class] = obj->next;
+        obj->next = sc->free;
+        sc->free = obj;
+        cache.count[size_class]--;
+    }
+    pthread_mutex_unlock(&sc->lock);
+    publish_in_use();
+}
+
+// Registers the thread cache so that it is flushed when the thread exits.
+static void cache_register() {
+    if (cache_registered) return;
+    pthread_once(&pool_once, pool_init);
+    pthread_setspecific(cache_key, &cache);
+
+    pthread_mutex_lock(&caches_lock);
+    cache.next = caches;
+    caches = &cache;
+    pthread_mutex_unlock(&caches_lock);
+    cache_registered = 1;
+}
+
+void* pool_alloc(size_t size, size_t align) {
+    int size_class = size_to_class(size, align);
+    if (size_class < 0) return NULL;
+
+    cache_register();
+
+    if (cache.free[size_class] == NULL) {
+        cache_refill(size_class);
+        if (cache.free[size_class] == NULL) return NULL;
+    }
+
+    struct free_object* obj = cache.free[size_class];
+    cache.free[size_class] = obj->next;
+    cache.count[size_class]--;
+
+    counter_add(&cache.in_use, class_size(size_class));
+    counter_add(&cache.allocations, 1);
+    return obj;
+}
+
+void pool_free(void* ptr) {
+    if (ptr == NULL) return;
+
+    struct slab* slab = (struct slab*) ((uintptr_t) ptr & ~(SLAB_SIZE - 1));
+    int size_class = slab->size_class;
+
+    cache_register();
+    struct free_object* obj = ptr;
+    obj->next = cache.free[size_class];
+    cache.free[size_class] = obj;
+    if (++cache.count[size_class] > CACHE_MAX) {
+        cache_flush(size_class, CACHE_BATCH);
+    }
+
+    counter_add(&cache.in_use, -class_size(size_class));
+}
+
+// Sums up the counters of all threads. A thread freeing objects allocated by
+// another thread has a negative balance, which the unsigned sum absorbs.
+void pool_stats(struct alloc_stats* stats) {
+    pthread_mutex_lock(&caches_lock);
+    stats->bytes_in_use = exited_in_use;
+    stats->allocations = exited_allocations;
+    for (struct thread_cache* c = caches; c != NULL; c = c->next) {
+        stats->bytes_in_use += atomic_load(&c->in_use);
+        stats->allocations += atomic_load(&c->allocations);
+    }
+    pthread_mutex_unlock(&caches_lock);
+
+    stats->bytes_reserved = atomic_load(&pool_reserved);
+    raise_high_water(stats->bytes_in_use);
+    stats->high_water_mark = atomic_load(&pool_high_water);
+}
+
+// Returns all slabs to the system. Only safe once every object has been freed
+// and all other threads using the pool have exited.
+void pool_release() {
+    pthread_once(&pool_once, pool_init);
+    for (int i = 0; i < POOL_CLASSES; i++) {
+        cache.free[i] = NULL;
+        cache.count[i] = 0;
+
+        struct slab* slab = classes[i].slabs;
+        while (slab != NULL) {
+            struct slab* next = slab->next;
+            free(slab);
+            slab = next;
+        }
+        classes[i].slabs = NULL;
+        classes[i].free = NULL;
+        classes[i].bump = NULL;
+        classes[i].bump_end = NULL;
+    }
+    atomic_store(&cache.in_use, 0);
+    atomic_store(&cache.allocations, 0);
+    cache.published = 0;
+    exited_in_use = 0;
+    exited_allocations = 0;
+    atomic_store(&pool_reserved, 0);
+    atomic_store(&pool_in_use, 0);
+    atomic_store(&pool_high_water, 0);
+}
+
+int is_aligned(void* ptr, size_t align) {
+    return 0 == ((uintptr_t) ptr % align);
+}
+
+int test_arena_alignment() {
+    struct arena arena;
+    arena_init(&arena);
+
+    int ret = 1;
+    for (size_t align = 1; align <= 4096; align *= 2) {
+        char* ptr = arena_alloc(&arena, 3, align);
+        ret = ret && ptr != NULL && is_aligned(ptr, align);
+        memset(ptr, 0xAB, 3);
+    }
+
+    arena_destroy(&arena);
+    return ret;
+}
+
+int test_arena_large_and_reset() {
+    struct arena arena;
+    arena_init(&arena);
+
+    void* small = arena_alloc(&arena, 100, 16);
+    void* large = arena_alloc(&arena, 3 * ARENA_CHUNK_SIZE, 64);
+    memset(large, 0, 3 * ARENA_CHUNK_SIZE);
+
+    struct alloc_stats stats;
+    arena_stats(&arena, &stats);
+    int ret = large != NULL && is_aligned(large, 64) &&
+              stats.bytes_in_use == 100 + 3 * ARENA_CHUNK_SIZE &&
+              stats.bytes_reserved >= 4 * ARENA_CHUNK_SIZE;
+
+    // After a reset the first allocation reuses the first chunk and no new
+    // memory is reserved while allocating the same amount again.
+    size_t reserved = stats.bytes_reserved;
+    arena_reset(&arena);
+    ret = ret && arena_alloc(&arena, 100, 16) == small;
+    arena_alloc(&arena, 3 * ARENA_CHUNK_SIZE, 64);
+    arena_stats(&arena, &stats);
+    ret = ret && stats.bytes_reserved == reserved &&
+          stats.high_water_mark == 100 + 3 * ARENA_CHUNK_SIZE;
+
+    arena_destroy(&arena);
+    return ret;
+}
+
+int test_pool_alignment() {
+    void* ptrs[POOL_CLASSES * 4];
+    int ret = 1, n = 0;
+    for (size_t align = 8; align <= POOL_MAX_SIZE; align *= 2) {
+        for (int i = 0; i < 4; i++) {
+            ptrs[n] = pool_alloc(align / 2 + 1, align);
+            ret = ret && ptrs[n] != NULL && is_aligned(ptrs[n], align);
+            memset(ptrs[n], 0xCD, align / 2 + 1);
+            n++;
+        }
+    }
+    for (int i = 0; i < n; i++) pool_free(ptrs[i]);
+
+    struct alloc_stats stats;
+    pool_stats(&stats);
+    ret = ret && stats.bytes_in_use == 0 && stats.high_water_mark > 0;
+    pool_release();
+    return ret && pool_alloc(POOL_MAX_SIZE + 1, 8) == NULL;
+}
+
+int test_pool_reuse() {
+    void* first = pool_alloc(48, 16);
+    pool_free(first);
+    void* second = pool_alloc(64, 64);
+    pool_free(second);
+    pool_release();
+    return first == second;
+}
+
+int test_pool_stats() {
+    void* ptrs[1000];
+    for (int i = 0; i < 1000; i++) ptrs[i] = pool_alloc(24, 8);
+
+    struct alloc_stats stats;
+    pool_stats(&stats);
+    int ret = stats.bytes_in_use == 1000 * 32 &&
+              stats.bytes_reserved == SLAB_SIZE &&
+              alloc_fragmentation(&stats) > 0.5;
+
+    for (int i = 0; i < 500; i++) pool_free(ptrs[i]);
+    pool_stats(&stats);
+    ret = ret && stats.bytes_in_use == 500 * 32 &&
+          stats.high_water_mark >= 1000 * 32 && stats.allocations == 1000;
+
+    for (int i = 500; i < 1000; i++) pool_free(ptrs[i]);
+    pool_release();
+    return ret;
+}
+
+// The high water mark counts bytes in use, not the objects that a refill
+// moves into the thread cache along with them.
+int test_pool_high_water() {
+    void* big = pool_alloc(POOL_MAX_SIZE, 8);
+    void* small = pool_alloc(8, 8);
+    struct alloc_stats stats;
+    pool_stats(&stats);
+    int ret = stats.high_water_mark == POOL_MAX_SIZE + 8;
+
+    // Repeatedly reusing the same objects does not raise the mark.
+    for (int i = 0; i < 1000; i++) {
+        pool_free(small);
+        small = pool_alloc(8, 8);
+    }
+    pool_free(big);
+    pool_free(small);
+
+    void* ptrs[200];
+    for (int i = 0; i < 200; i++) ptrs[i] = pool_alloc(64, 8);
+    for (int i = 0; i < 200; i++) pool_free(ptrs[i]);
+    pool_stats(&stats);
+    ret = ret && stats.bytes_in_use == 0 &&
+          stats.high_water_mark >= 200 * 64 - CACHE_MAX * 64 &&
+          stats.high_water_mark <= 200 * 64 + POOL_MAX_SIZE + 8;
+    pool_release();
+    return ret;
+}
+
+#define THREAD_OBJECTS 20000
+
+// Each thread allocates objects, writes a pattern into them, verifies the
+// pattern and frees them, half of them from another thread's allocations.
+void* pool_worker(void* arg) {
+    void** ptrs = arg;
+    for (int i = 0; i < THREAD_OBJECTS; i++) {
+        ptrs[i] = pool_alloc(40, 8);
+        memset(ptrs[i], i & 0xFF, 40);
+    }
+    return NULL;
+}
+
+int test_pool_threads() {
+    pthread_t threads[4];
+    void** ptrs = malloc(4 * THREAD_OBJECTS * sizeof(void*));
+    for (int t = 0; t < 4; t++) {
+        pthread_create(&threads[t], NULL, pool_worker,
+                       ptrs + t * THREAD_OBJECTS);
+    }
+    for (int t = 0; t < 4; t++) pthread_join(threads[t], NULL);
+
+    int ret = 1;
+    for (int i = 0; i < 4 * THREAD_OBJECTS; i++) {
+        unsigned char* bytes = ptrs[i];
+        ret = ret && bytes[0] == ((i % THREAD_OBJECTS) & 0xFF) &&
+              bytes[39] == ((i % THREAD_OBJECTS) & 0xFF);
+        pool_free(ptrs[i]);
+    }
+
+    struct alloc_stats stats;
+    pool_stats(&stats);
+    ret = ret && stats.bytes_in_use == 0 &&
+          stats.allocations == 4 * THREAD_OBJECTS;
+    free(ptrs);
+    pool_release();
+    return ret;
+}
+
+double elapsed_ms(struct timespec* start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1e3 +
+           (end.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+void* bench_posix_memalign(size_t size, size_t align) {
+    void* ptr = NULL;
+    return posix_memalign(&ptr, align, size) == 0 ? ptr : NULL;
+}
+
+void* bench_aligned_malloc(size_t size, size_t align) {
+    return aligned_malloc(size, align);
+}
+
+void* bench_malloc(size_t size, size_t align) {
+    (void) align;
+    return malloc(size);
+}
+
+void* bench_pool(size_t size, size_t align) {
+    return pool_alloc(size, align);
+}
+
+// Allocates count objects, frees every other one, reallocates them and
+// finally frees all of them.
+double run_allocator(void* (*alloc)(size_t, size_t), void (*release)(void*),
+                     void** ptrs, int count, size_t size, size_t align) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (int i = 0; i < count; i++) ptrs[i] = alloc(size, align);
+    for (int i = 0; i < count; i += 2) release(ptrs[i]);
+    for (int i = 0; i < count; i += 2) ptrs[i] = alloc(size, align);
+    for (int i = 0; i < count; i++) release(ptrs[i]);
+
+    return elapsed_ms(&start);
+}
+
+double run_arena(void** ptrs, int count, size_t size, size_t align) {
+    struct arena arena;
+    arena_init(&arena);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int round = 0; round < 2; round++) {
+        for (int i = 0; i < count; i++) {
+            ptrs[i] = arena_alloc(&arena, size, align);
+        }
+        arena_reset(&arena);
+    }
+    double ms = elapsed_ms(&start);
+
+    arena_destroy(&arena);
+    return ms;
+}
+
+void run_benchmark(int count, size_t size, size_t align) {
+    void** ptrs = malloc(count * sizeof(void*));
+
+    printf("%d,%zu,%zu,%.2f,%.2f,%.2f,%.2f,%.2f\n", count, size, align,
+           run_allocator(bench_malloc, free, ptrs, count, size, align),
+           run_allocator(bench_posix_memalign, free, ptrs, count, size, align),
+           run_allocator(bench_aligned_malloc, aligned_free, ptrs, count,
+                         size, align),
+           run_allocator(bench_pool, pool_free, ptrs, count, size, align),
+           run_arena(ptrs, count, size, align));
+
+    pool_release();
+    free(ptrs);
+}
+
+int main() {
+    int counter = 0;
+    if (!test_arena_alignment()) {
+        printf("Arena alignment test failed!\n");
+        counter++;
+    }
+    if (!test_arena_large_and_reset()) {
+        printf("Arena large allocation and reset test failed!\n");
+        counter++;
+    }
+    if (!test_pool_alignment()) {
+        printf("Pool alignment test failed!\n");
+        counter++;
+    }
+    if (!test_pool_reuse()) {
+        printf("Pool reuse test failed!\n");
+        counter++;
+    }
+    if (!test_pool_stats()) {
+        printf("Pool stats test failed!\n");
+        counter++;
+    }
+    if (!test_pool_high_water()) {
+        printf("Pool high water test failed!\n");
+        counter++;
+    }
+    if (!test_pool_threads()) {
+        printf("Pool threads test failed!\n");
+        counter++;
+    }
+    printf("%d tests failed.\n", counter);
+
+    printf("count,size,align,malloc_ms,posix_memalign_ms,aligned_malloc_ms,"
+           "pool_ms,arena_ms\n");
+    run_benchmark(1000000, 16, 16);
+    run_benchmark(1000000, 48, 16);
+    run_benchmark(1000000, 64, 64);
+    run_benchmark(1000000, 200, 256);
+    run_benchmark(100000, 1024, 4096);
+}
@@ -0,0 +1,595 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// Task description: The Node tree in rank_stream.cpp stores every integer of
+// the stream to provide exact ranks, so its memory grows without bound, and it
+// can only be used by a single thread. For unbounded streams that are produced
+// by many threads, approximate ranks and percentiles are good enough. Design a
+// mergeable quantile sketch that provides the same insert() and rank()
+// interface in bounded memory. Each thread should insert into its own sketch,
+// and these should be merged when queried. Sketches should also be
+// serializable, so that sketches of different shards can be combined. Measure
+// the accuracy against the exact Node::rank() and the ingest rate for 1 to 32
+// threads.
+//
+// Solution: The implementation below is a KLL sketch. It consists of a number
+// of compactors (levels), each holding a buffer of values. Every value held at
+// level h stands for 2^h values of the stream. New values are appended to
+// level 0. When the sketch holds as many values as the sum of the capacities
+// of all levels, the lowest level that has reached its capacity is compacted:
+// its values are sorted and either the ones at even or the ones at odd
+// positions (chosen at random) are promoted to the next level, while the rest
+// are discarded. Each compaction therefore halves the number of values held,
+// while doubling their weight, and changes the rank of any value by at most
+// the weight of the level, with equal chance in both directions.
+//
+// The top level has capacity k and each level below it has 2/3 of the
+// capacity of the level above, but never less than 8. The total number of
+// values held is therefore at most about 3k, no matter how long the stream
+// is, while the error of the estimated ranks is O(n / k) with high
+// probability. The estimated number of values less than or equal to x is the
+// sum of the weights of all held values less than or equal to x.
+//
+// Sketches with the same k are merged by concatenating their levels and
+// compacting levels as above until the sketch is within its capacity. The
+// result is a sketch of the same quality as if all values had been inserted
+// into it.
+//
+// ConcurrentSketch holds one KLL sketch per thread, each padded to its own
+// cache line and protected by its own mutex. The mutex is uncontended, except
+// while a query is in progress, and is acquired once per batch of values
+// rather than once per value. Queries merge all per thread sketches into a
+// snapshot, which is then used to answer any number of rank queries.
+//
+// The serialized form of a sketch contains k, the stream size, the number of
+// levels and then the size and values of each level, all in host byte order.
+//
+// Largest rank error as a fraction of the stream, for 1M random values, of a
+// single sketch and of 16 shards that were serialized and merged:
+//
+// +-----+----------+-------+--------+--------+
+// |  k  | Retained | Bytes | Single | Merged |
+// +-----+----------+-------+--------+--------+
+// |  50 |      207 |   904 |  2.06% |  1.55% |
+// | 100 |      331 |  1396 |  1.35% |  0.80% |
+// | 200 |      607 |  2496 |  0.87% |  0.40% |
+// | 400 |     1186 |  4808 |  0.29% |  0.40% |
+// | 800 |     2361 |  9504 |  0.19% |  0.13% |
+// +-----+----------+-------+--------+--------+
+//
+// With k = 200, ingesting 100M values in batches of 256 runs at about 20M
+// values per second and merging 32 per thread sketches takes about 1ms. All
+// measurements were taken on a single core, so the ingest rate does not grow
+// with the number of threads here, but it also does not drop, as threads
+// never wait for each other.
+//
+// Compile with: g++ -O2 -pthread quantile_sketch.cpp
+
+// Same Node tree as in rank_stream.cpp, used as the exact reference.
+class Node {
+
+    private:
+        Node* left;
+        Node* right;
+        int value;
+        int left_size;
+
+    public:
+        Node(int number) : left(NULL),
+                           right(NULL),
+                           value(number),
+                           left_size(0) { }
+        void insert(int number);
+        int rank(int number);
+};
+
+void Node::insert(int number) {
+    if (number <= value) {
+        if (left == NULL) {
+            left = new Node(number);
+        } else {
+            left->insert(number);
+        }
+        left_size++;
+    } else {
+        if (right == NULL) {
+            right = new Node(number);
+        } else {
+            right->insert(number);
+        }
+    }
+}
+
+int Node::rank(int number) {
+    if (value == number) {
+        return left_size;
+    }
+
+    if (number < value) {
+        return left == NULL ? -1 : left->rank(number);
+    } else {
+        int rank = right == NULL ? -1 : right->rank(number);
+        return rank == -1 ? -1 : rank + left_size + 1;
+    }
+}
+
+class KllSketch {
+
+    private:
+        static constexpr uint32_t MIN_CAPACITY = 8;
+
+        uint32_t k;
+        uint64_t count;
+        size_t held;
+        size_t limit;
+        uint32_t seed;
+        std::vector< std::vector<int> > levels;
+
+        uint32_t capacity(size_t level) const;
+        void update_limit();
+        void compact(size_t level);
+        void compress();
+
+    public:
+        KllSketch(uint32_t k = 200);
+        void insert(int number);
+        void merge(const KllSketch& other);
+        uint64_t less_or_equal(int number) const;
+        int rank(int number) const;
+        int quantile(double fraction) const;
+        uint64_t size() const { return count; }
+        size_t retained() const { return held; }
+        std::vector<uint8_t> serialize() const;
+        static KllSketch deserialize(const std::vector<uint8_t>& bytes);
+};
+
+KllSketch::KllSketch(uint32_t k) : k(k), count(0), held(0), limit(k),
+                                   seed(2463534242u) {
+    if (k < MIN_CAPACITY) throw std::invalid_argument("k is too small");
+    levels.resize(1);
+}
+
+uint32_t KllSketch::capacity(size_t level) const {
+    double scaled = k * std::pow(2.0 / 3.0, levels.size() - 1 - level);
+    return std::max(MIN_CAPACITY, (uint32_t) scaled);
+}
+
+void KllSketch::update_limit() {
+    limit = 0;
+    for (size_t level = 0; level < levels.size(); level++) {
+        limit += capacity(level);
+    }
+}
+
+// Sorts the values of the given level and promotes every other one to the
+// next level, starting from a random position. If the number of values is
+// odd, the largest one stays behind.
+void KllSketch::compact(size_t level) {
+    if (level + 1 == levels.size()) {
+        levels.emplace_back();
+        update_limit();
+    }
+
+    std::vector<int>& buffer = levels[level];
+    std::vector<int>& above = levels[level + 1];
+    std::sort(buffer.begin(), buffer.end());
+
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    size_t even = buffer.size() & ~(size_t) 1;
+    for (size_t i = seed & 1; i < even; i += 2) above.push_back(buffer[i]);
+    held -= even / 2;
+
+    if (even < buffer.size()) {
+        buffer[0] = buffer[even];
+        buffer.resize(1);
+    } else {
+        buffer.clear();
+    }
+}
+
+// While the sketch holds more values than the sum of the capacities of its
+// levels, compacts the lowest level that is over its capacity.
+void KllSketch::compress() {
+    while (held >= limit) {
+        size_t level = 0;
+        while (levels[level].size() < capacity(level)) level++;
+        compact(level);
+    }
+}
+
+void KllSketch::insert(int number) {
+    levels[0].push_back(number);
+    count++;
+    held++;
+    if (held >= limit) compress();
+}
+
+void KllSketch::merge(const KllSketch& other) {
+    if (k != other.k) throw std::invalid_argument("Sketches have different k");
+
+    if (levels.size() < other.levels.size()) {
+        levels.resize(other.levels.size());
+        update_limit();
+    }
+    for (size_t level = 0; level < other.levels.size(); level++) {
+        levels[level].insert(levels[level].end(), other.levels[level].begin(),
+                             other.levels[level].end());
+    }
+    count += other.count;
+    held += other.held;
+    compress();
+}
+
+// Returns the estimated number of values in the stream that are less than or
+// equal to the given number.
+uint64_t KllSketch::less_or_equal(int number) const {
+    uint64_t total = 0;
+    for (size_t level = 0; level < levels.size(); level++) {
+        uint64_t below = 0;
+        for (int value : levels[level]) below += value <= number;
+        total += below << level;
+    }
+    return std::min(total, count);
+}
+
+// Same definition as Node::rank(), assuming that the number is in the stream.
+// As the sketch does not know which numbers are in the stream, it never
+// returns -1, unless the stream is empty.
+int KllSketch::rank(int number) const {
+    uint64_t total = less_or_equal(number);
+    return total == 0 ? -1 : (int) (total - 1);
+}
+
+// Returns the smallest held value whose estimated rank is at least the given
+// fraction of the stream, e.g. quantile(0.5) is the median.
+int KllSketch::quantile(double fraction) const {
+    if (count == 0) throw std::out_of_range("Sketch is empty");
+
+    std::vector< std::pair<int, uint64_t> > weighted;
+    for (size_t level = 0; level < levels.size(); level++) {
+        for (int value : levels[level]) weighted.emplace_back(value, 1ULL << level);
+    }
+    std::sort(weighted.begin(), weighted.end());
+
+    double target = fraction * count;
+    uint64_t total = 0;
+    for (const std::pair<int, uint64_t>& item : weighted) {
+        total += item.second;
+        if (total >= target) return item.first;
+    }
+    return weighted.back().first;
+}
+
+
+template <typename T>
+static void write(std::vector<uint8_t>& bytes, const T& value) {
+    const uint8_t* start = reinterpret_cast<const uint8_t*>(&value);
+    bytes.insert(bytes.end(), start, start + sizeof(T));
+}
+
+template <typename T>
+static T read(const std::vector<uint8_t>& bytes, size_t& offset) {
+    if (bytes.size() - offset < sizeof(T)) {
+        throw std::invalid_argument("Serialized sketch is truncated");
+    }
+    T value;
+    memcpy(&value, &bytes[offset], sizeof(T));
+    offset += sizeof(T);
+    return value;
+}
+
+std::vector<uint8_t> KllSketch::serialize() const {
+    std::vector<uint8_t> bytes;
+    write(bytes, k);
+    write(bytes, count);
+    write(bytes, (uint32_t) levels.size());
+    for (const std::vector<int>& level : levels) {
+        write(bytes, (uint32_t) level.size());
+        for (int value : level) write(bytes, value);
+    }
+    return bytes;
+}
+
+KllSketch KllSketch::deserialize(const std::vector<uint8_t>& bytes) {
+    size_t offset = 0;
+    KllSketch sketch(read<uint32_t>(bytes, offset));
+    sketch.count = read<uint64_t>(bytes, offset);
+    uint32_t levels = read<uint32_t>(bytes, offset);
+    if (levels == 0 || levels > 64) {
+        throw std::invalid_argument("Serialized sketch is corrupt");
+    }
+
+    sketch.levels.resize(levels);
+    for (std::vector<int>& level : sketch.levels) {
+        uint32_t size = read<uint32_t>(bytes, offset);
+        if (size > (bytes.size() - offset) / sizeof(int)) {
+            throw std::invalid_argument("Serialized sketch is truncated");
+        }
+        level.resize(size);
+        for (int& value : level) value = read<int>(bytes, offset);
+        sketch.held += size;
+    }
+    sketch.update_limit();
+    sketch.compress();
+    return sketch;
+}
+
+class ConcurrentSketch {
+
+    private:
+        struct alignas(64) Shard {
+            std::mutex lock;
+            KllSketch sketch;
+            Shard(uint32_t k) : sketch(k) { }
+        };
+
+        uint32_t k;
+        std::vector< std::unique_ptr<Shard> > shards;
+
+    public:
+        ConcurrentSketch(int threads, uint32_t k = 200);
+        void insert(int thread, int number);
+        void insert(int thread, const int* numbers, size_t size);
+        KllSketch snapshot();
+        int rank(int number) { return snapshot().rank(number); }
+};
+
+ConcurrentSketch::ConcurrentSketch(int threads, uint32_t k) : k(k) {
+    for (int i = 0; i < threads; i++) shards.emplace_back(new Shard(k));
+}
+
+void ConcurrentSketch::insert(int thread, int number) {
+    Shard& shard = *shards[thread];
+    std::lock_guard<std::mutex> guard(shard.lock);
+    shard.sketch.insert(number);
+}
+
+void ConcurrentSketch::insert(int thread, const int* numbers, size_t size) {
+    Shard& shard = *shards[thread];
+    std::lock_guard<std::mutex> guard(shard.lock);
+    for (size_t i = 0; i < size; i++) shard.sketch.insert(numbers[i]);
+}
+
+// Merges the sketches of all threads into a new sketch.
+KllSketch ConcurrentSketch::snapshot() {
+    KllSketch merged(k);
+    for (std::unique_ptr<Shard>& shard : shards) {
+        std::lock_guard<std::mutex> guard(shard->lock);
+        merged.merge(shard->sketch);
+    }
+    return merged;
+}
+
+// Cheap random number generator (xorshift) for the test streams.
+static uint32_t next_random(uint32_t& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// Returns the largest difference between estimated and exact rank, as a
+// fraction of the stream size, over the given query values.
+double max_error(const KllSketch& sketch, Node& exact,
+                 const std::vector<int>& queries, uint64_t size) {
+    double worst = 0;
+    for (int value : queries) {
+        double error = std::abs(sketch.rank(value) - exact.rank(value));
+        worst = std::max(worst, error / size);
+    }
+    return worst;
+}
+
+bool test_small_stream_is_exact() {
+    KllSketch sketch;
+    int values[] = { 10, 2, 5, 15, 8, 12, 12, 20 };
+    for (int value : values) sketch.insert(value);
+
+    return -1 == sketch.rank(1) && 0 == sketch.rank(2) &&
+           1 == sketch.rank(5) && 2 == sketch.rank(8) &&
+           3 == sketch.rank(10) && 5 == sketch.rank(12) &&
+           6 == sketch.rank(15) && 7 == sketch.rank(20) &&
+           7 == sketch.rank(100) && 10 == sketch.quantile(0.5) &&
+           2 == sketch.quantile(0) && 20 == sketch.quantile(1) &&
+           8 == sketch.size();
+}
+
+bool test_bounded_memory() {
+    KllSketch sketch(100);
+    for (int i = 0; i < 1000000; i++) sketch.insert(i);
+    return sketch.retained() <= 400 && 1000000 == sketch.size();
+}
+
+bool test_accuracy() {
+    KllSketch sketch(200);
+    uint32_t state = 1;
+    Node exact(500000);
+    std::vector<int> queries;
+    for (int i = 1; i < 200000; i++) {
+        int value = next_random(state) % 1000000;
+        sketch.insert(value);
+        exact.insert(value);
+        if (i % 1000 == 0) queries.push_back(value);
+    }
+    return max_error(sketch, exact, queries, 200000) < 0.02 &&
+           std::abs(sketch.quantile(0.5) - 500000) < 20000;
+}
+
+bool test_merge() {
+    KllSketch left(200), right(200), all(200);
+    for (int i = 0; i < 100000; i++) {
+        (i % 2 == 0 ? left : right).insert(i);
+        all.insert(i);
+    }
+    left.merge(right);
+
+    bool ret = 100000 == left.size() && left.retained() <= 3 * 200;
+    for (int value = 0; value < 100000; value += 1000) {
+        ret = ret && std::abs(left.rank(value) - value) < 2000;
+    }
+    return ret;
+}
+
+bool test_merge_different_k() {
+    KllSketch left(100), right(200);
+    try {
+        left.merge(right);
+        return false;
+    } catch (const std::invalid_argument& e) {
+        return true;
+    }
+}
+
+bool test_serialize() {
+    KllSketch sketch(50);
+    for (int i = 0; i < 10000; i++) sketch.insert(i * 7 % 10000 - 5000);
+    KllSketch copy = KllSketch::deserialize(sketch.serialize());
+
+    bool ret = copy.size() == sketch.size() &&
+               copy.retained() == sketch.retained() &&
+               copy.serialize() == sketch.serialize();
+    for (int value = -6000; value < 6000; value += 100) {
+        ret = ret && copy.rank(value) == sketch.rank(value);
+    }
+
+    std::vector<uint8_t> bytes = sketch.serialize();
+    bytes.resize(bytes.size() - 1);
+    try {
+        KllSketch::deserialize(bytes);
+        return false;
+    } catch (const std::invalid_argument& e) {
+        return ret;
+    }
+}
+
+bool test_concurrent() {
+    ConcurrentSketch sketch(4, 200);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < 4; t++) {
+        workers.push_back(std::thread([&sketch, t]() {
+            for (int i = t; i < 100000; i += 4) sketch.insert(t, i);
+        }));
+    }
+    for (std::thread& worker : workers) worker.join();
+
+    KllSketch merged = sketch.snapshot();
+    return 100000 == merged.size() &&
+           std::abs(merged.rank(50000) - 50000) < 2000;
+}
+
+double elapsed_sec(std::chrono::steady_clock::time_point start) {
+    std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+void accuracy_benchmark(int size) {
+    std::vector<int> values(size);
+    uint32_t state = 42;
+    for (int& value : values) value = next_random(state) % 100000000;
+
+    Node exact(values[0]);
+    for (int i = 1; i < size; i++) exact.insert(values[i]);
+    std::vector<int> queries;
+    for (int i = 0; i < 1000; i++) queries.push_back(values[i * (size / 1000)]);
+
+    std::cout << "k,values,retained,bytes,max_error,merged_max_error"
+              << std::endl;
+    for (uint32_t k = 50; k <= 800; k *= 2) {
+        KllSketch single(k);
+        for (int value : values) single.insert(value);
+
+        // The same stream split across 16 shards and merged.
+        std::vector<KllSketch> shards(16, KllSketch(k));
+        for (int i = 0; i < size; i++) shards[i % 16].insert(values[i]);
+        KllSketch merged(k);
+        for (KllSketch& shard : shards) {
+            merged.merge(KllSketch::deserialize(shard.serialize()));
+        }
+
+        std::cout << k << "," << size << "," << single.retained() << ","
+                  << single.serialize().size() << ","
+                  << max_error(single, exact, queries, size) << ","
+                  << max_error(merged, exact, queries, size) << std::endl;
+    }
+}
+
+void ingest_benchmark(int size) {
+    const size_t batch = 256;
+    std::cout << "threads,values,ingest_mops,snapshot_ms,median" << std::endl;
+    for (int threads = 1; threads <= 32; threads *= 2) {
+        ConcurrentSketch sketch(threads);
+        std::vector<std::thread> workers;
+        auto start = std::chrono::steady_clock::now();
+        for (int t = 0; t < threads; t++) {
+            workers.push_back(std::thread([&sketch, t, threads, size]() {
+                uint32_t state = 2654435761u * (t + 1);
+                int buffer[batch];
+                for (int done = 0; done < size / threads; done += batch) {
+                    for (size_t i = 0; i < batch; i++) {
+                        buffer[i] = next_random(state) % 100000000;
+                    }
+                    sketch.insert(t, buffer, batch);
+                }
+            }));
+        }
+        for (std::thread& worker : workers) worker.join();
+        double ingest_sec = elapsed_sec(start);
+
+        start = std::chrono::steady_clock::now();
+        KllSketch merged = sketch.snapshot();
+        double snapshot_sec = elapsed_sec(start);
+
+        std::cout << threads << "," << merged.size() << ","
+                  << merged.size() / ingest_sec / 1e6 << ","
+                  << snapshot_sec * 1000 << "," << merged.quantile(0.5)
+                  << std::endl;
+    }
+}
+
+int main() {
+    int counter = 0;
+    if (!test_small_stream_is_exact()) {
+        std::cout << "Small stream is exact test failed!" << std::endl;
+        counter++;
+    }
+    if (!test_bounded_memory()) {
+        std::cout << "Bounded memory test failed!" << std::endl;
+        counter++;
+    }
+    if (!test_accuracy()) {
+        std::cout << "Accuracy test failed!" << std::endl;
+        counter++;
+    }
+    if (!test_merge()) {
+        std::cout << "Merge test failed!" << std::endl;
+        counter++;
+    }
+    if (!test_merge_different_k()) {
+        std::cout << "Merge different k test failed!" << std::endl;
+        counter++;
+    }
+    if (!test_serialize()) {
+        std::cout << "Serialize test failed!" << std::endl;
+        counter++;
+    }
+    if (!test_concurrent()) {
+        std::cout << "Concurrent test failed!" << std::endl;
+        counter++;
+    }
+    std::cout << counter << " tests failed." << std::endl;
+
+    accuracy_benchmark(1000000);
+    ingest_benchmark(100000000);
+}
@@ -1,4 +1,11 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
 #include <iostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
 
 // Task description: Given a stream of integers, implement a data structure to
 // store these integers and also efficiently provide the rank of a given value.
@@ -22,6 +29,66 @@
 // the counter is incremented as necessary. Finding the rank is as simple as
 // locating the element in the tree and summing up the counter of that node and
 // any other parent node where we had to go right.
+//
+// The problem with the Node tree is that it is not balanced. If the stream
+// arrives sorted, every value is inserted to the right of the previous one and
+// the tree degenerates into a linked list: insertion and ranking become O(n)
+// and the recursion becomes as deep as the stream is long. The same happens
+// with duplicates, as every copy of a value is inserted below the previous
+// one. Two alternatives are implemented below:
+//
+// (1) RankTree is a treap, i.e. a binary search tree where each node also has
+//     a random priority and parents always have a higher priority than their
+//     children. Whatever the order of the stream, the shape of the tree is the
+//     one we would get by inserting the values in random order, so its
+//     expected depth is O(logn). Each node holds a distinct value together
+//     with the number of its copies and the size of its subtree, so duplicates
+//     do not add any nodes. insert() walks down iteratively, remembering the
+//     path in a reusable vector, attaches the new leaf and then rotates it up
+//     while its priority is higher than its parent's. rank() and select()
+//     walk down once, adding up or subtracting the sizes of the left subtrees.
+//     All nodes are stored in a single vector that acts as a pool and are
+//     linked using 32-bit indices instead of pointers, with index 0 as the
+//     empty node of size 0. This halves the size of the links and saves one
+//     allocation per value.
+//
+// (2) FenwickRank is for streams whose values are known to be within a small
+//     enough domain [low, high]. It holds a Fenwick (binary indexed) tree with
+//     one counter per possible value, so that insert(), rank() and select()
+//     are O(log(high - low)) without any comparisons of values, rotations or
+//     random priorities. select() descends the implicit tree from the highest
+//     power of two, one bit at a time.
+//
+// Million operations per second on a single core, for streams of 100M values
+// that are sorted, random in [0, n) and random in [0, 1000), with ranks
+// queried in arrival order and select() for random ranks:
+//
+// +--------+-------------+--------+------+--------+
+// | Stream | Structure   | Insert | Rank | Select |
+// +--------+-------------+--------+------+--------+
+// | Sorted | RankTree    |   6.35 | 4.67 |   0.16 |
+// | Sorted | FenwickRank |   33.8 | 30.9 |   0.67 |
+// | Sorted | Node (10K)  |   0.09 | 0.01 |      - |
+// | Random | RankTree    |   0.13 | 0.12 |   0.11 |
+// | Random | FenwickRank |   5.46 | 6.31 |   0.82 |
+// | Random | Node (10M)  |   0.36 | 0.37 |      - |
+// | Dupes  | RankTree    |   13.5 | 10.5 |   9.52 |
+// | Dupes  | FenwickRank |   51.1 | 32.2 |   12.5 |
+// | Dupes  | Node (100K) |   0.42 | 9.65 |      - |
+// +--------+-------------+--------+------+--------+
+//
+// With random values, every level of RankTree is a cache miss once the tree
+// is larger than the cache, so it is not faster than the Node tree, whose
+// shape is equally random. Its benefit is that it cannot degenerate.
+//
+// The Node tree needs O(n^2) for the sorted stream and for the duplicates,
+// so it is only benchmarked up to 10K and 100K values respectively.
+//
+// By default the benchmark stops at 1M values, which takes about 10 seconds.
+// The table above comes from ./a.out 100000000, which takes tens of minutes.
+//
+// Compile with: g++ -O2 rank_stream.cpp
+// Run with: ./a.out [max_values, 1000000 by default]
 
 class Node {
 
@@ -70,6 +137,211 @@ int Node::rank(int number) {
     }
 }
 
+class RankTree {
+
+    private:
+        struct TreeNode {
+            int value;
+            uint32_t left;
+            uint32_t right;
+            uint32_t priority;
+            uint32_t count;
+            uint32_t size;
+        };
+
+        std::vector<TreeNode> pool;
+        std::vector<uint32_t> path;
+        uint32_t root;
+        uint32_t seed;
+
+        uint32_t next_priority();
+        void update(uint32_t index);
+
+    public:
+        RankTree(size_t capacity = 0);
+        void insert(int number);
+        int rank(int number) const;
+        int select(uint32_t k) const;
+        uint32_t size() const { return pool[root].size; }
+        size_t nodes() const { return pool.size() - 1; }
+};
+
+RankTree::RankTree(size_t capacity) : root(0), seed(2463534242u) {
+    pool.reserve(capacity + 1);
+    pool.push_back(TreeNode{0, 0, 0, 0, 0, 0});
+}
+
+uint32_t RankTree::next_priority() {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+void RankTree::update(uint32_t index) {
+    TreeNode& node = pool[index];
+    node.size = pool[node.left].size + pool[node.right].size + node.count;
+}
+
+void RankTree::insert(int number) {
+    path.clear();
+    uint32_t current = root;
+    while (current != 0) {
+        TreeNode& node = pool[current];
+        node.size++;
+        if (number == node.value) {
+            node.count++;
+            return;
+        }
+        path.push_back(current);
+        current = number < node.value ? node.left : node.right;
+    }
+
+    uint32_t added = pool.size();
+    pool.push_back(TreeNode{number, 0, 0, next_priority(), 1, 1});
+    if (path.empty()) {
+        root = added;
+        return;
+    }
+
+    uint32_t parent = path.back();
+    if (number < pool[parent].value) {
+        pool[parent].left = added;
+    } else {
+        pool[parent].right = added;
+    }
+
+    // Rotate the new node up until its parent has a higher priority.
+    while (!path.empty()) {
+        parent = path.back();
+        path.pop_back();
+        TreeNode& above = pool[parent];
+        TreeNode& below = pool[added];
+        if (above.priority >= below.priority) return;
+
+        if (above.left == added) {
+            above.left = below.right;
+            below.right = parent;
+        } else {
+            above.right = below.left;
+            below.left = parent;
+        }
+        update(parent);
+        update(added);
+
+        if (path.empty()) {
+            root = added;
+        } else if (pool[path.back()].left == parent) {
+            pool[path.back()].left = added;
+        } else {
+            pool[path.back()].right = added;
+        }
+    }
+}
+
+int RankTree::rank(int number) const {
+    uint32_t less = 0;
+    uint32_t current = root;
+    while (current != 0) {
+        const TreeNode& node = pool[current];
+        if (number < node.value) {
+            current = node.left;
+        } else if (number > node.value) {
+            less += pool[node.left].size + node.count;
+            current = node.right;
+        } else {
+            return less + pool[node.left].size + node.count - 1;
+        }
+    }
+    return -1;
+}
+
+// Returns the k-th smallest value in the stream, counting from 0.
+int RankTree::select(uint32_t k) const {
+    if (k >= size()) throw std::out_of_range("Rank is out of range");
+
+    uint32_t current = root;
+    while (true) {
+        const TreeNode& node = pool[current];
+        uint32_t left_size = pool[node.left].size;
+        if (k < left_size) {
+            current = node.left;
+        } else if (k < left_size + node.count) {
+            return node.value;
+        } else {
+            k -= left_size + node.count;
+            current = node.right;
+        }
+    }
+}
+
+class FenwickRank {
+
+    private:
+        int low;
+        int high;
+        uint32_t total;
+        uint32_t top;
+        std::vector<uint32_t> tree;
+
+        uint32_t prefix(uint32_t index) const;
+
+    public:
+        FenwickRank(int low, int high);
+        void insert(int number);
+        int rank(int number) const;
+        int select(uint32_t k) const;
+        uint32_t size() const { return total; }
+};
+
+FenwickRank::FenwickRank(int low, int high) : low(low), high(high), total(0) {
+    if (low > high) throw std::invalid_argument("Domain is empty");
+    uint32_t length = (int64_t) high - low + 1;
+    tree.assign(length + 1, 0);
+    top = 1;
+    while (top <= length / 2) top <<= 1;
+}
+
+// Returns the number of values in the first index positions of the domain.
+uint32_t FenwickRank::prefix(uint32_t index) const {
+    uint32_t sum = 0;
+    for (; index > 0; index &= index - 1) sum += tree[index];
+    return sum;
+}
+
+void FenwickRank::insert(int number) {
+    if (number < low || number > high) {
+        throw std::out_of_range("Value is out of the domain");
+    }
+    for (uint32_t i = (int64_t) number - low + 1; i < tree.size(); i += i & -i) {
+        tree[i]++;
+    }
+    total++;
+}
+
+int FenwickRank::rank(int number) const {
+    if (number < low || number > high) return -1;
+    uint32_t index = (int64_t) number - low + 1;
+    uint32_t upto = prefix(index);
+    if (upto == prefix(index - 1)) return -1;
+    return upto - 1;
+}
+
+// Returns the k-th smallest value in the stream, counting from 0.
+int FenwickRank::select(uint32_t k) const {
+    if (k >= total) throw std::out_of_range("Rank is out of range");
+
+    uint32_t position = 0;
+    for (uint32_t step = top; step > 0; step >>= 1) {
+        uint32_t next = position + step;
+        if (next < tree.size() && tree[next] <= k) {
+            position = next;
+            k -= tree[next];
+        }
+    }
+    return (int64_t) low + position;
+}
+
 bool test_rank_not_found() {
     Node root(10);
     root.insert(2);
@@ -109,7 +381,162 @@ bool test_rank() {
            7 == root.rank(20);
 }
 
-int main() {
+template <typename T>
+void insert_example(T& stream) {
+    int values[] = { 10, 2, 5, 15, 8, 12, 12, 20 };
+    for (int value : values) stream.insert(value);
+}
+
+template <typename T>
+bool check_example(const T& stream) {
+    return -1 == stream.rank(1) && -1 == stream.rank(3) &&
+           -1 == stream.rank(6) && -1 == stream.rank(9) &&
+           -1 == stream.rank(11) && -1 == stream.rank(14) &&
+           -1 == stream.rank(17) && -1 == stream.rank(23) &&
+           0 == stream.rank(2) && 1 == stream.rank(5) &&
+           2 == stream.rank(8) && 3 == stream.rank(10) &&
+           5 == stream.rank(12) && 6 == stream.rank(15) &&
+           7 == stream.rank(20) &&
+           2 == stream.select(0) && 10 == stream.select(3) &&
+           12 == stream.select(4) && 12 == stream.select(5) &&
+           20 == stream.select(7) && 8 == stream.size();
+}
+
+template <typename T>
+bool check_select_out_of_range(const T& stream) {
+    try {
+        stream.select(stream.size());
+        return false;
+    } catch (const std::out_of_range& e) {
+        return true;
+    }
+}
+
+bool test_tree() {
+    RankTree tree;
+    insert_example(tree);
+    return check_example(tree) && check_select_out_of_range(tree) &&
+           7 == tree.nodes();
+}
+
+bool test_tree_sorted() {
+    RankTree tree;
+    for (int i = 0; i < 100000; i++) tree.insert(i);
+
+    bool ret = true;
+    for (int i = 0; i < 100000; i++) {
+        ret = ret && i == tree.rank(i) && i == tree.select(i);
+    }
+    return ret && -1 == tree.rank(-1) && -1 == tree.rank(100000);
+}
+
+bool test_tree_against_node() {
+    Node root(250);
+    RankTree tree;
+    tree.insert(250);
+    srand(7);
+    for (int i = 0; i < 20000; i++) {
+        int value = rand() % 500 - 100;
+        root.insert(value);
+        tree.insert(value);
+    }
+
+    bool ret = true;
+    for (int value = -101; value <= 400; value++) {
+        int rank = tree.rank(value);
+        ret = ret && root.rank(value) == rank;
+        if (rank != -1) ret = ret && value == tree.select(rank);
+    }
+    return ret;
+}
+
+bool test_fenwick() {
+    FenwickRank fenwick(0, 20);
+    insert_example(fenwick);
+    return check_example(fenwick) && check_select_out_of_range(fenwick) &&
+           -1 == fenwick.rank(-5) && -1 == fenwick.rank(21);
+}
+
+bool test_fenwick_domain() {
+    FenwickRank fenwick(-1000, -3);
+    RankTree tree;
+    for (int i = 0; i < 10000; i++) {
+        int value = -3 - (i * 7919) % 998;
+        fenwick.insert(value);
+        tree.insert(value);
+    }
+
+    bool ret = true;
+    for (int value = -1001; value <= -2; value++) {
+        ret = ret && tree.rank(value) == fenwick.rank(value);
+    }
+    for (uint32_t k = 0; k < 10000; k += 37) {
+        ret = ret && tree.select(k) == fenwick.select(k);
+    }
+    try {
+        fenwick.insert(-2);
+        return false;
+    } catch (const std::out_of_range& e) {
+        return ret;
+    }
+}
+
+double elapsed_sec(std::chrono::steady_clock::time_point start) {
+    std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+template <typename T>
+int select_value(const T& stream, uint32_t k) { return stream.select(k); }
+
+// The Node tree does not support select.
+template <>
+int select_value(const Node&, uint32_t) { return 0; }
+
+// Inserts all values in a new stream, then ranks all values in the order they
+// arrived and finally selects as many random ranks. Node trees are leaked, as
+// they do not have a destructor and freeing a degenerate tree recursively
+// would overflow the stack.
+template <typename T, typename F>
+void benchmark(const char* stream_name, const char* structure,
+               const std::vector<int>& values, F create) {
+    auto start = std::chrono::steady_clock::now();
+    T* stream = create();
+    for (size_t i = std::is_same<T, Node>::value ? 1 : 0;
+         i < values.size(); i++) {
+        stream->insert(values[i]);
+    }
+    double insert_sec = elapsed_sec(start);
+
+    long checksum = 0;
+    start = std::chrono::steady_clock::now();
+    for (int value : values) checksum += stream->rank(value);
+    double rank_sec = elapsed_sec(start);
+
+    uint32_t state = 12345;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < values.size(); i++) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        checksum += select_value(*stream, state % values.size());
+    }
+    double select_sec = elapsed_sec(start);
+
+    double mops = values.size() / 1e6;
+    std::cout << stream_name << "," << values.size() << "," << structure << ","
+              << mops / insert_sec << "," << mops / rank_sec << ",";
+    if (std::is_same<T, Node>::value) {
+        std::cout << "-";
+    } else {
+        std::cout << mops / select_sec;
+        delete stream;
+    }
+    std::cout << "," << checksum << std::endl;
+}
+
+int main(int argc, char** argv) {
     int counter = 0;
     if (!test_rank_not_found()) {
         std::cout << "Rank not found test failed!" << std::endl;
@@ -119,6 +546,53 @@ int main() {
         std::cout << "Rank test failed!" << std::endl;
         counter++;
     }
+    if (!test_tree()) {
+        std::cout << "Tree test failed!" << std::endl;
+        counter++;
+    }
+    if (!test_tree_sorted()) {
+        std::cout << "Tree sorted test failed!" << std::endl;
+        counter++;
+    }
+    if (!test_tree_against_node()) {
+        std::cout << "Tree against node test failed!" << std::endl;
+        counter++;
+    }
+    if (!test_fenwick()) {
+        std::cout << "Fenwick test failed!" << std::endl;
+        counter++;
+    }
+    if (!test_fenwick_domain()) {
+        std::cout << "Fenwick domain test failed!" << std::endl;
+        counter++;
+    }
     std::cout << counter << " tests failed." << std::endl;
-}
 
+    size_t max_values = argc > 1 ? atol(argv[1]) : 1000000;
+    std::cout << "stream,values,structure,insert_mops,rank_mops,select_mops,checksum"
+              << std::endl;
+    for (size_t n = 10000; n <= max_values; n *= 10) {
+        std::vector<int> values(n);
+        for (const char* stream : { "sorted", "random", "dupes" }) {
+            std::string name(stream);
+            uint64_t state = 42;
+            int domain = name == "dupes" ? 1000 : n;
+            for (size_t i = 0; i < n; i++) {
+                state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+                values[i] = name == "sorted" ? i : (state >> 33) % domain;
+            }
+
+            benchmark<RankTree>(stream, "tree", values,
+                                [&]() { return new RankTree(n); });
+            benchmark<FenwickRank>(stream, "fenwick", values,
+                                   [&]() { return new FenwickRank(0, domain - 1); });
+
+            size_t node_limit = name == "sorted" ? 10000 :
+                                name == "dupes" ? 100000 : 10000000;
+            if (n <= node_limit) {
+                benchmark<Node>(stream, "node", values,
+                                [&]() { return new Node(values[0]); });
+            }
+        }
+    }
+}
@@ -0,0 +1,510 @@
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Task description: The SmartPointer in smart_pointers.cpp allocates its
+// reference count separately from the object, its count operations are not
+// thread safe and it has no move constructor, so passing it around by value
+// always costs an increment and a decrement. Write an improved smart pointer
+// that:
+//
+// (1) Provides make_smart<T>(args...) to allocate the object and the reference
+//     counts in a single block of memory.
+// (2) Uses atomic reference counts by default, but allows choosing a cheaper
+//     non atomic policy for single threaded code through a template parameter.
+// (3) Supports move semantics and weak references.
+//
+// Compare copy, move and destroy throughput against std::shared_ptr.
+//
+// Solution: The reference counts are kept in a control block. When the smart
+// pointer is created from a raw pointer, the control block is allocated
+// separately and simply deletes the object once the count reaches zero. When
+// make_smart() is used, the control block is allocated together with storage
+// for the object and the object is constructed in place using placement new.
+// This halves the number of allocations and places the counts right next to
+// the object, so that both usually share a cache line.
+//
+// Each control block holds two counters: the number of strong references and
+// the number of weak references. The object is destroyed when the strong count
+// reaches zero, but the control block itself is only released when the weak
+// count also reaches zero, as weak pointers still need to inspect the strong
+// count. As an optimization, all strong references together hold a single weak
+// reference, so that destroying the last strong reference only has to touch
+// the weak count once.
+//
+// The counting policy is a template parameter. AtomicCount uses std::atomic
+// with relaxed increments and acquire / release decrements, which is the
+// minimum ordering required to ensure the object is not destroyed while
+// another thread is still using it. PlainCount uses plain unsigned integers
+// and is only suitable when all copies live on the same thread.
+//
+// A WeakPointer does not keep the object alive. Its lock() method tries to
+// increment the strong count only if it is not already zero, which for the
+// atomic policy is done using a compare and swap loop.
+//
+// Move construction and move assignment steal the pointers from the source,
+// leaving it empty, without touching the counts at all.
+//
+// Compile with: g++ -O2 -pthread smart_pointers2.cpp
+
+struct AtomicCount {
+    std::atomic<unsigned> value;
+
+    AtomicCount(unsigned initial) : value(initial) { }
+
+    void increment() {
+        value.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Returns true if the count dropped to zero.
+    bool decrement() {
+        if (value.fetch_sub(1, std::memory_order_release) == 1) {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return true;
+        }
+        return false;
+    }
+
+    bool increment_if_not_zero() {
+        unsigned current = value.load(std::memory_order_relaxed);
+        while (current != 0) {
+            if (value.compare_exchange_weak(current, current + 1,
+                                            std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    unsigned get() {
+        return value.load(std::memory_order_relaxed);
+    }
+};
+
+struct PlainCount {
+    unsigned value;
+
+    PlainCount(unsigned initial) : value(initial) { }
+
+    void increment() { value++; }
+    bool decrement() { return --value == 0; }
+    unsigned get() { return value; }
+
+    bool increment_if_not_zero() {
+        if (value == 0) return false;
+        value++;
+        return true;
+    }
+};
+
+template <class Count> class ControlBlock {
+
+    public:
+        Count strong;
+        Count weak;
+
+        ControlBlock() : strong(1), weak(1) { }
+        virtual ~ControlBlock() { }
+
+        // Destroys the referenced object.
+        virtual void dispose() = 0;
+
+        void release_strong() {
+            if (strong.decrement()) {
+                dispose();
+                release_weak();
+            }
+        }
+
+        void release_weak() {
+            if (weak.decrement()) delete this;
+        }
+};
+
+// Control block for objects allocated separately with new.
+template <class T, class Count> class SeparateBlock : public ControlBlock<Count> {
+
+    private:
+        T* ref;
+
+    public:
+        SeparateBlock(T* ptr) : ref(ptr) { }
+        void dispose() { delete ref; }
+};
+
+// Control block that also holds the object itself, used by make_smart().
+template <class T, class Count> class FusedBlock : public ControlBlock<Count> {
+
+    private:
+        alignas(T) unsigned char storage[sizeof(T)];
+
+    public:
+        template <class... Args> FusedBlock(Args&&... args) {
+            new (storage) T(std::forward<Args>(args)...);
+        }
+
+        T* get() { return reinterpret_cast<T*>(storage); }
+        void dispose() { get()->~T(); }
+};
+
+template <class T, class Count> class WeakPointer;
+
+template <class T, class Count = AtomicCount> class SmartPointer {
+
+    private:
+        T* ref;
+        ControlBlock<Count>* block;
+
+        SmartPointer(T* ptr, ControlBlock<Count>* block) :
+                ref(ptr), block(block) { }
+
+        template <class U, class C, class... Args>
+        friend SmartPointer<U, C> make_smart(Args&&... args);
+        friend class WeakPointer<T, Count>;
+
+    public:
+        SmartPointer() : ref(NULL), block(NULL) { }
+
+        explicit SmartPointer(T* ptr) : ref(ptr), block(NULL) {
+            if (ptr != NULL) block = new SeparateBlock<T, Count>(ptr);
+        }
+
+        SmartPointer(const SmartPointer& sptr) :
+                ref(sptr.ref), block(sptr.block) {
+            if (block != NULL) block->strong.increment();
+        }
+
+        SmartPointer(SmartPointer&& sptr) noexcept :
+                ref(sptr.ref), block(sptr.block) {
+            sptr.ref = NULL;
+            sptr.block = NULL;
+        }
+
+        ~SmartPointer() {
+            if (block != NULL) block->release_strong();
+        }
+
+        // Copy and swap: the parameter is either copied or moved into, which
+        // handles both assignment kinds and self assignment.
+        SmartPointer& operator=(SmartPointer sptr) noexcept {
+            std::swap(ref, sptr.ref);
+            std::swap(block, sptr.block);
+            return *this;
+        }
+
+        T& operator*() const { return *ref; }
+        T* operator->() const { return ref; }
+        T* get() const { return ref; }
+        explicit operator bool() const { return ref != NULL; }
+
+        T getValue() {
+            return *ref;
+        }
+
+        unsigned getRefCount() {
+            return block == NULL ? 0 : block->strong.get();
+        }
+};
+
+template <class T, class Count = AtomicCount> class WeakPointer {
+
+    private:
+        T* ref;
+        ControlBlock<Count>* block;
+
+    public:
+        WeakPointer() : ref(NULL), block(NULL) { }
+
+        WeakPointer(const SmartPointer<T, Count>& sptr) :
+                ref(sptr.ref), block(sptr.block) {
+            if (block != NULL) block->weak.increment();
+        }
+
+        WeakPointer(const WeakPointer& wptr) : ref(wptr.ref), block(wptr.block) {
+            if (block != NULL) block->weak.increment();
+        }
+
+        WeakPointer(WeakPointer&& wptr) noexcept :
+                ref(wptr.ref), block(wptr.block) {
+            wptr.ref = NULL;
+            wptr.block = NULL;
+        }
+
+        ~WeakPointer() {
+            if (block != NULL) block->release_weak();
+        }
+
+        WeakPointer& operator=(WeakPointer wptr) noexcept {
+            std::swap(ref, wptr.ref);
+            std::swap(block, wptr.block);
+            return *this;
+        }
+
+        bool expired() {
+            return block == NULL || block->strong.get() == 0;
+        }
+
+        // Returns a strong reference to the object or an empty SmartPointer
+        // if the object has already been destroyed.
+        SmartPointer<T, Count> lock() {
+            if (block == NULL || !block->strong.increment_if_not_zero()) {
+                return SmartPointer<T, Count>();
+            }
+            return SmartPointer<T, Count>(ref, block);
+        }
+};
+
+template <class T, class Count = AtomicCount, class... Args>
+SmartPointer<T, Count> make_smart(Args&&... args) {
+    FusedBlock<T, Count>* block =
+            new FusedBlock<T, Count>(std::forward<Args>(args)...);
+    return SmartPointer<T, Count>(block->get(), block);
+}
+
+// Counts live instances so that tests can verify destruction.
+struct Tracked {
+    static int alive;
+    int value;
+
+    Tracked(int value) : value(value) { alive++; }
+    ~Tracked() { alive--; }
+};
+
+int Tracked::alive = 0;
+
+bool test_constructors() {
+    int* ptr = new int;
+    *ptr = 10;
+
+    SmartPointer<int> sptr(ptr);
+    SmartPointer<int> sptr2(sptr);
+
+    return 10 == sptr.getValue() &&
+           10 == sptr2.getValue() &&
+           2 == sptr.getRefCount() &&
+           2 == sptr2.getRefCount();
+}
+
+bool test_operator_equals() {
+    SmartPointer<int> sptr(new int);
+    SmartPointer<int> sptr2(new int);
+    SmartPointer<int> sptr3(sptr2);
+    sptr2 = sptr;
+
+    return 2 == sptr.getRefCount() &&
+           2 == sptr2.getRefCount() &&
+           1 == sptr3.getRefCount();
+}
+
+bool test_self_assignment() {
+    SmartPointer<int> sptr = make_smart<int>(5);
+    SmartPointer<int>& alias = sptr;
+    sptr = alias;
+    return 1 == sptr.getRefCount() && 5 == sptr.getValue();
+}
+
+bool test_make_smart() {
+    bool ret;
+    {
+        SmartPointer<Tracked> sptr = make_smart<Tracked>(42);
+        SmartPointer<Tracked> sptr2 = sptr;
+        ret = 42 == sptr->value && 2 == sptr2.getRefCount() &&
+              1 == Tracked::alive;
+    }
+    return ret && 0 == Tracked::alive;
+}
+
+// std::vector only moves its elements on reallocation if moving cannot throw.
+static_assert(std::is_nothrow_move_constructible<SmartPointer<int>>::value &&
+              std::is_nothrow_move_assignable<SmartPointer<int>>::value &&
+              std::is_nothrow_move_constructible<WeakPointer<int>>::value &&
+              std::is_nothrow_move_assignable<WeakPointer<int>>::value,
+              "Moving smart pointers must not throw");
+
+bool test_move() {
+    SmartPointer<int> sptr = make_smart<int>(7);
+    SmartPointer<int> sptr2(std::move(sptr));
+    SmartPointer<int> sptr3;
+    sptr3 = std::move(sptr2);
+
+    return !sptr && !sptr2 && 7 == *sptr3 && 1 == sptr3.getRefCount();
+}
+
+bool test_weak_lock() {
+    SmartPointer<Tracked> sptr = make_smart<Tracked>(3);
+    WeakPointer<Tracked> wptr(sptr);
+    SmartPointer<Tracked> locked = wptr.lock();
+
+    return !wptr.expired() && 3 == locked->value &&
+           2 == sptr.getRefCount();
+}
+
+bool test_weak_expired() {
+    WeakPointer<Tracked> wptr;
+    {
+        SmartPointer<Tracked> sptr(new Tracked(3));
+        wptr = sptr;
+    }
+    return wptr.expired() && !wptr.lock() && 0 == Tracked::alive;
+}
+
+bool test_plain_count() {
+    SmartPointer<int, PlainCount> sptr = make_smart<int, PlainCount>(9);
+    SmartPointer<int, PlainCount> sptr2 = sptr;
+    WeakPointer<int, PlainCount> wptr(sptr2);
+    SmartPointer<int, PlainCount> locked = wptr.lock();
+    return 9 == *locked && 3 == sptr.getRefCount();
+}
+
+bool test_concurrent_copies() {
+    SmartPointer<Tracked> sptr = make_smart<Tracked>(1);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.push_back(std::thread([&sptr]() {
+            for (int i = 0; i < 100000; i++) {
+                SmartPointer<Tracked> copy = sptr;
+            }
+        }));
+    }
+    for (std::thread& thread : threads) thread.join();
+
+    bool ret = 1 == sptr.getRefCount();
+    sptr = SmartPointer<Tracked>();
+    return ret && 0 == Tracked::alive;
+}
+
+template <class Ptr> double copy_benchmark(Ptr& shared, int threads, int ops) {
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < threads; t++) {
+        workers.push_back(std::thread([&shared, threads, ops]() {
+            for (int i = 0; i < ops / threads; i++) {
+                Ptr copy = shared;
+            }
+        }));
+    }
+    for (std::thread& worker : workers) worker.join();
+    std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+    return ops / elapsed.count();
+}
+
+// Moves pointers around a ring with one empty slot. The slot visited next
+// depends on the loop counter, so the moves cannot be folded away, and the
+// ring is checked afterwards to make sure every pointer survived.
+template <class Ptr> double move_benchmark(Ptr& shared, int ops) {
+    const int size = 64;
+    std::vector<Ptr> ring(size, shared);
+    ring[0] = Ptr();
+    int hole = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ops; i++) {
+        int next = (hole + 1 + (i & 7)) & (size - 1);
+        ring[hole] = std::move(ring[next]);
+        hole = next;
+    }
+    std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+
+    int live = 0;
+    for (const Ptr& ptr : ring) live += ptr.get() == shared.get();
+    return live == size - 1 ? ops / elapsed.count() : 0;
+}
+
+template <class Ptr, class Make>
+double create_destroy_benchmark(Make make, int threads, int ops) {
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < threads; t++) {
+        workers.push_back(std::thread([make, threads, ops]() {
+            for (int i = 0; i < ops / threads; i++) {
+                Ptr ptr = make(i);
+            }
+        }));
+    }
+    for (std::thread& worker : workers) worker.join();
+    std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+    return ops / elapsed.count();
+}
+
+void run_benchmark(int ops) {
+    typedef SmartPointer<int> Smart;
+    typedef SmartPointer<int, PlainCount> PlainSmart;
+    typedef std::shared_ptr<int> Shared;
+
+    Smart smart = make_smart<int>(1);
+    PlainSmart plain = make_smart<int, PlainCount>(1);
+    Shared shared = std::make_shared<int>(1);
+
+    std::cout << "benchmark,threads,smart_ops_sec,shared_ptr_ops_sec"
+              << std::endl;
+    for (int threads = 1; threads <= 8; threads *= 2) {
+        std::cout << "copy," << threads << ","
+                  << (long) copy_benchmark(smart, threads, ops) << ","
+                  << (long) copy_benchmark(shared, threads, ops) << std::endl;
+    }
+    for (int threads = 1; threads <= 8; threads *= 2) {
+        auto make_s = [](int i) { return make_smart<int>(i); };
+        auto make_sh = [](int i) { return std::make_shared<int>(i); };
+        std::cout << "make_destroy," << threads << ","
+                  << (long) create_destroy_benchmark<Smart>(make_s, threads, ops)
+                  << ","
+                  << (long) create_destroy_benchmark<Shared>(make_sh, threads, ops)
+                  << std::endl;
+    }
+    std::cout << "move,1," << (long) move_benchmark(smart, ops) << ","
+              << (long) move_benchmark(shared, ops) << std::endl;
+    std::cout << "copy_plain_count,1,"
+              << (long) copy_benchmark(plain, 1, ops) << ","
+              << (long) copy_benchmark(shared, 1, ops) << std::endl;
+}
+
+int main() {
+    int counter = 0;
+    if (!test_constructors()) {
+        std::cout << "Constructors test failed!" << std::endl;
+        counter++;
+    }
+    if (!test_operator_equals()) {
+        std::cout << "Operator equals test failed!" << std::endl;
+        counter++;
+    }
+    if (!test_self_assignment()) {
+        std::cout << "Self assignment test failed!" << std::endl;
+        counter++;
+    }
+    if (!test_make_smart()) {
+        std::cout << "Make smart test failed!" << std::endl;
+        counter++;
+    }
+    if (!test_move()) {
+        std::cout << "Move test failed!" << std::endl;
+        counter++;
+    }
+    if (!test_weak_lock()) {
+        std::cout << "Weak pointer lock test failed!" << std::endl;
+        counter++;
+    }
+    if (!test_weak_expired()) {
+        std::cout << "Weak pointer expired test failed!" << std::endl;
+        counter++;
+    }
+    if (!test_plain_count()) {
+        std::cout << "Plain count policy test failed!" << std::endl;
+        counter++;
+    }
+    if (!test_concurrent_copies()) {
+        std::cout << "Concurrent copies test failed!" << std::endl;
+        counter++;
+    }
+    std::cout << counter << " tests failed." << std::endl;
+
+    run_benchmark(1 << 22);
+}